@@ -10,11 +10,15 @@ S_SRCS += \
 ../asm.s 
 
 C_SRCS += \
+../bench.c \
 ../clock.c \
 ../faults.c \
 ../gpio.c \
 ../kernel.c \
+../kprintf.c \
+../log.c \
 ../mm.c \
+../pool.c \
 ../rtos.c \
 ../shell.c \
 ../string.c \
@@ -27,11 +31,15 @@ S_DEPS += \
 ./asm.d 
 
 C_DEPS += \
+./bench.d \
 ./clock.d \
 ./faults.d \
 ./gpio.d \
 ./kernel.d \
+./kprintf.d \
+./log.d \
 ./mm.d \
+./pool.d \
 ./rtos.d \
 ./shell.d \
 ./string.d \
@@ -42,11 +50,15 @@ C_DEPS += \
 
 OBJS += \
 ./asm.obj \
+./bench.obj \
 ./clock.obj \
 ./faults.obj \
 ./gpio.obj \
 ./kernel.obj \
+./kprintf.obj \
+./log.obj \
 ./mm.obj \
+./pool.obj \
 ./rtos.obj \
 ./shell.obj \
 ./string.obj \
@@ -57,11 +69,15 @@ OBJS += \
 
 OBJS__QUOTED += \
 "asm.obj" \
+"bench.obj" \
 "clock.obj" \
 "faults.obj" \
 "gpio.obj" \
 "kernel.obj" \
+"kprintf.obj" \
+"log.obj" \
 "mm.obj" \
+"pool.obj" \
 "rtos.obj" \
 "shell.obj" \
 "string.obj" \
@@ -71,11 +87,15 @@ OBJS__QUOTED += \
 "wait.obj" 
 
 C_DEPS__QUOTED += \
+"bench.d" \
 "clock.d" \
 "faults.d" \
 "gpio.d" \
 "kernel.d" \
+"kprintf.d" \
+"log.d" \
 "mm.d" \
+"pool.d" \
 "rtos.d" \
 "shell.d" \
 "string.d" \
@@ -91,11 +111,15 @@ S_SRCS__QUOTED += \
 "../asm.s" 
 
 C_SRCS__QUOTED += \
+"../bench.c" \
 "../clock.c" \
 "../faults.c" \
 "../gpio.c" \
 "../kernel.c" \
+"../kprintf.c" \
+"../log.c" \
 "../mm.c" \
+"../pool.c" \
 "../rtos.c" \
 "../shell.c" \
 "../string.c" \
@@ -17,6 +17,7 @@
 #define ASM_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 //-----------------------------------------------------------------------------
 // Subroutines
@@ -30,15 +31,50 @@ extern uint32_t* getMSP();
 extern void launchTaskUnprivileged(uint32_t address);
 extern void pushHwHandledRegsToPsp(uint32_t pspAddress, uint32_t xPsr, uint32_t fnAddress);
 extern uint32_t getPid(const char process[]);
-extern uint8_t getMutexInfo(void *mutexStruct, uint8_t num);
-extern uint8_t getSemaphoreInfo(void *semaphoreStruct, uint8_t num);
+extern uint8_t getObjectInfo(void *objectStruct, uint8_t num);
+extern uint32_t getHandle(const char name[]);
 extern uint8_t getTaskInfo(void *taskStruct, uint8_t num);
 extern void runThread(uint32_t fn);
 extern void killThread(uint32_t fn);
+extern bool spawnThread(uint32_t fn, const char name[], uint8_t priority, uint32_t stackBytes);
+extern bool removeThread(uint32_t fn);
+extern uint32_t getHeapFree();
+extern bool timeHeap(void *latency);
+extern void* getTaskHeap();
+extern bool getHeapInfo(void *info);
+extern bool getHeapBlockInfo(void *block, uint8_t num);
+extern uint8_t compactStacks();
+extern uint32_t consoleWrite(const void* buf, uint32_t n);
+extern uint32_t consoleRead(void* buf, uint32_t n);
+extern uint32_t consoleReadLine(char* buf, uint32_t n);
+extern bool consoleWriteAll(const void* buf, uint32_t n);
+extern bool inUnprivilegedTask();
+extern uint32_t logReserve(uint32_t* head, uint32_t records);
 extern void enablePreemption();
 extern void disablePreemption();
-extern void setSchedPriority();
-extern void setSchedRoundRobin();
-extern void changeThreadPriority(uint32_t fn, uint8_t prio);
+extern bool setSchedPriority();
+extern bool setSchedRoundRobin();
+extern uint8_t changeThreadPriority(uint32_t fn, uint8_t prio);
+extern uint32_t createMutex(const char name[]);
+extern uint32_t createSemaphore(uint8_t count, const char name[]);
+extern bool deleteObject(uint32_t handle);
+extern uint32_t createRwLock(const char name[]);
+extern uint32_t createCondition(const char name[]);
+extern uint32_t createEvent(const char name[]);
+extern uint32_t waitEvent(uint32_t handle, uint32_t mask);
+extern uint32_t setBasePri(uint32_t basePri);
+extern uint32_t takeNotification(bool clear);
+extern uint32_t getTaskHandle(const char name[]);
+extern uint32_t createShared(uint32_t size, const char name[]);
+extern bool grantShared(uint32_t shared, uint32_t task, uint8_t access);
+extern void* mapShared(uint32_t shared);
+extern uint32_t createRecursiveMutex(const char name[]);
+extern bool waitBarrier(uint32_t barrier);
+extern uint32_t createBarrier(uint8_t count, const char name[]);
+extern uint32_t createTimer(void (*callback)(uint32_t arg), uint32_t arg, const char name[]);
+extern void takeTimer(void *expiry);
+extern uint32_t createPipe(uint16_t size, const char name[]);
+extern uint32_t pipeWrite(uint32_t pipe, const void* buf, uint32_t n);
+extern uint32_t pipeRead(uint32_t pipe, void* buf, uint32_t n);
 
 #endif
@@ -21,8 +21,8 @@
 	.def launchTaskUnprivileged
 	.def pushHwHandledRegsToPsp
 	.def getPid
-	.def getMutexInfo
-	.def getSemaphoreInfo
+	.def getObjectInfo
+	.def getHandle
 	.def getTaskInfo
 	.def runThread
 	.def killThread
@@ -31,6 +31,48 @@
 	.def setSchedPriority
 	.def setSchedRoundRobin
 	.def changeThreadPriority
+	.def createMutex
+	.def createSemaphore
+	.def deleteObject
+	.def createRwLock
+	.def createCondition
+	.def createEvent
+	.def waitEvent
+	.def setBasePri
+	.def takeNotification
+	.def getTaskHandle
+	.def createShared
+	.def grantShared
+	.def mapShared
+	.def createPipe
+	.def pipeWrite
+	.def pipeRead
+	.def lock
+	.def unlock
+	.def readLock
+	.def readUnlock
+	.def writeLock
+	.def writeUnlock
+	.def waitCondition
+	.def createRecursiveMutex
+	.def waitBarrier
+	.def createBarrier
+	.def createTimer
+	.def takeTimer
+	.def spawnThread
+	.def removeThread
+	.def getHeapFree
+	.def timeHeap
+	.def getTaskHeap
+	.def getHeapInfo
+	.def getHeapBlockInfo
+	.def compactStacks
+	.def consoleWrite
+	.def consoleRead
+	.def consoleReadLine
+	.def consoleWriteAll
+	.def inUnprivilegedTask
+	.def logReserve
 
 ;-----------------------------------------------------------------------------
 ; Register values and large immediate values
@@ -106,15 +148,15 @@ getPid:
 			   SVC	 #6
 			   BX LR
 
-; Gets info of mutex given the number (R0->ptr to start of struct, R1->mutex num)
-	.global getMutexInfo
-getMutexInfo:
+; Gets info of kernel object given the pool index (R0->ptr to start of struct, R1->object num)
+	.global getObjectInfo
+getObjectInfo:
 			   SVC	 #7
 			   BX LR
 
-; Gets info of semaphore give the number (R0->ptr to start of struct, R1->semaphore num)
-	.global getSemaphoreInfo
-getSemaphoreInfo:
+; Gets handle of kernel object given the name (R0->ptr to start of str)
+	.global getHandle
+getHandle:
 			   SVC	 #8
 			   BX LR
 
@@ -149,22 +191,397 @@ disablePreemption:
 			   BX LR
 
 
-; Enables priority scheduling
+; Enables priority scheduling, returns whether it was already on
 	.global setSchedPriority
 setSchedPriority:
 			   SVC	 #14
 			   BX LR
 
-; Enables round robin scheduling
+; Enables round robin scheduling, returns whether the priority scheduler was on
 	.global setSchedRoundRobin
 setSchedRoundRobin:
 			   SVC	 #15
 			   BX LR
 
-; Changes thread priority
+; Changes thread priority (R0->fn, R1->priority), returns the previous priority
 	.global changeThreadPriority
 changeThreadPriority:
 			   SVC	 #16
 			   BX LR
 
+; Creates mutex, returns handle (R0->ptr to name)
+	.global createMutex
+createMutex:
+			   SVC	 #17
+			   BX LR
+
+; Creates semaphore, returns handle (R0->initial count, R1->ptr to name)
+	.global createSemaphore
+createSemaphore:
+			   SVC	 #18
+			   BX LR
+
+; Deletes unused mutex or semaphore (R0->handle)
+	.global deleteObject
+deleteObject:
+			   SVC	 #19
+			   BX LR
+
+; Creates reader-writer lock, returns handle (R0->ptr to name)
+	.global createRwLock
+createRwLock:
+			   SVC	 #24
+			   BX LR
+
+; Creates condition variable, returns handle (R0->ptr to name)
+	.global createCondition
+createCondition:
+			   SVC	 #28
+			   BX LR
+
+; Creates event flags object, returns handle (R0->ptr to name)
+	.global createEvent
+createEvent:
+			   SVC	 #31
+			   BX LR
+
+; Waits for any of the masked event flags, returns and clears the flags that were set
+; (R0->handle, R1->mask), kernel sets R1 when the task blocked so the call is retried
+	.global waitEvent
+waitEvent:
+			   MOV	 R2, R0
+			   MOV	 R3, R1
+WAIT_EVENT:
+			   MOV	 R0, R2
+			   MOV	 R1, R3
+			   SVC	 #29
+			   CMP	 R1, #0
+			   BNE	 WAIT_EVENT
+			   BX LR
+
+; Sets BASEPRI to mask lower priority exceptions, returns previous value (R0->new BASEPRI)
+; Privileged only, writes from unprivileged code are ignored
+	.global setBasePri
+setBasePri:
+			   MRS	 R1, BASEPRI
+			   MSR	 BASEPRI, R0
+			   MOV	 R0, R1
+			   BX LR
+
+; Waits for the task's notification word to be non-zero and returns it
+; (R0->true to clear the word, false to decrement it), kernel sets R1 when the task blocked
+	.global takeNotification
+takeNotification:
+			   MOV	 R2, R0
+TAKE_NOTIFICATION:
+			   MOV	 R0, R2
+			   SVC	 #33
+			   CMP	 R1, #0
+			   BNE	 TAKE_NOTIFICATION
+			   BX LR
+
+; Gets handle of task given the name, used as notify target (R0->ptr to start of str)
+	.global getTaskHandle
+getTaskHandle:
+			   SVC	 #34
+			   BX LR
+
+; Allocates a shared memory region, the caller gets read-write access (R0->size, R1->ptr to start of str)
+	.global createShared
+createShared:
+			   SVC	 #35
+			   BX LR
+
+; Gives a task access to a shared region, returns false if refused (R0->region, R1->task, R2->access)
+	.global grantShared
+grantShared:
+			   SVC	 #36
+			   BX LR
+
+; Returns the address of a shared region, or 0 if the caller was not granted access (R0->region)
+	.global mapShared
+mapShared:
+			   SVC	 #37
+			   BX LR
+
+; Creates a pipe with a buffer of the given size (R0->size, R1->ptr to start of str)
+	.global createPipe
+createPipe:
+			   SVC	 #38
+			   BX LR
+
+; Writes n bytes into a pipe, blocking while it is full, returns the bytes written (R0->pipe, R1->buf, R2->n)
+; the kernel returns the bytes copied in R0 and sets R1 when the task blocked, so the rest is retried
+	.global pipeWrite
+pipeWrite:
+			   PUSH	 {R4, R5}
+			   MOV	 R3, R0
+			   MOV	 R4, R1
+			   MOV	 R5, R2
+			   MOV	 R12, R2
+PIPE_WRITE:
+			   MOV	 R0, R3
+			   MOV	 R1, R4
+			   MOV	 R2, R5
+			   SVC	 #39
+			   ADD	 R4, R4, R0
+			   SUB	 R5, R5, R0
+			   CMP	 R1, #0
+			   BNE	 PIPE_WRITE
+			   SUB	 R0, R12, R5
+			   POP	 {R4, R5}
+			   BX LR
+
+; Reads up to n bytes from a pipe, blocking until at least one is available, returns the bytes read
+; (R0->pipe, R1->buf, R2->n), kernel sets R1 when the task blocked so the call is retried
+	.global pipeRead
+pipeRead:
+			   MOV	 R3, R0
+			   MOV	 R12, R1
+PIPE_READ:
+			   MOV	 R0, R3
+			   MOV	 R1, R12
+			   SVC	 #40
+			   CMP	 R1, #0
+			   BNE	 PIPE_READ
+			   BX LR
+
+; Locks a mutex, blocking until it is free (R0->handle), returns false for a bad handle or
+; when the owner locks a non-recursive mutex again (that would deadlock)
+	.global lock
+lock:
+			   SVC	 #2
+			   BX LR
+
+; Unlocks a mutex (R0->handle), returns false if the caller does not own it
+	.global unlock
+unlock:
+			   SVC	 #3
+			   BX LR
+
+; Takes shared read access to a rwlock, blocking while a writer holds or waits for it (R0->handle),
+; returns false for a bad handle or when the caller already holds it (that would deadlock)
+	.global readLock
+readLock:
+			   SVC	 #20
+			   BX LR
+
+; Drops read access (R0->handle), returns false if the caller is not a reader
+	.global readUnlock
+readUnlock:
+			   SVC	 #21
+			   BX LR
+
+; Takes exclusive write access to a rwlock, blocking until all readers have left (R0->handle),
+; returns false for a bad handle or when the caller already holds it, a reader can't upgrade
+	.global writeLock
+writeLock:
+			   SVC	 #22
+			   BX LR
+
+; Drops write access (R0->handle), returns false if the caller is not the writer
+	.global writeUnlock
+writeUnlock:
+			   SVC	 #23
+			   BX LR
+
+; Releases the mutex and waits on the condition in one step, returns owning the mutex again
+; (R0->condition, R1->mutex), returns false without waiting unless the caller holds the mutex exactly once
+	.global waitCondition
+waitCondition:
+			   SVC	 #25
+			   BX LR
+
+; Creates a mutex the owner may lock again, unlocking once per lock (R0->ptr to start of str)
+	.global createRecursiveMutex
+createRecursiveMutex:
+			   SVC	 #41
+			   BX LR
+
+; Waits until count tasks have reached the barrier (R0->handle), returns true in the last task to arrive
+	.global waitBarrier
+waitBarrier:
+			   SVC	 #42
+			   BX LR
+
+; Creates a barrier for count tasks, reusable phase after phase (R0->count, R1->ptr to start of str)
+	.global createBarrier
+createBarrier:
+			   SVC	 #43
+			   BX LR
+
+; Creates a stopped software timer (R0->callback, R1->callback arg, R2->ptr to start of str)
+	.global createTimer
+createTimer:
+			   SVC	 #44
+			   BX LR
+
+; Timer daemon only: waits for a timer to expire and fills in its callback (R0->expiry struct),
+; kernel sets R1 when the task blocked so the call is retried
+	.global takeTimer
+takeTimer:
+			   MOV	 R2, R0
+TAKE_TIMER:
+			   MOV	 R0, R2
+			   SVC	 #48
+			   CMP	 R1, #0
+			   BNE	 TAKE_TIMER
+			   BX LR
+
+; Creates a thread (R0->fn, R1->ptr to start of name str, R2->priority, R3->stack bytes)
+	.global spawnThread
+spawnThread:
+			   SVC	 #49
+			   BX LR
+
+; Deletes a thread, freeing its stack and tcb (R0->pid)
+	.global removeThread
+removeThread:
+			   SVC	 #50
+			   BX LR
+
+; Gets the number of free bytes in the heap
+	.global getHeapFree
+getHeapFree:
+			   SVC	 #51
+			   BX LR
+
+; Times random heap allocations and frees in the kernel (R0->ptr to HEAP_LATENCY), one chunk per SVC
+; (R2 = 1 starts the run, the kernel sets R1 while there are rounds left)
+	.global timeHeap
+timeHeap:
+			   MOV	 R3, R0
+			   MOV	 R2, #1
+TIME_HEAP:
+			   MOV	 R0, R3
+			   SVC	 #52
+			   MOV	 R2, #0
+			   CMP	 R1, #0
+			   BNE	 TIME_HEAP
+			   BX LR
+
+; Gets the calling task's private heap (0 if it was created without one)
+	.global getTaskHeap
+getTaskHeap:
+			   SVC	 #53
+			   BX LR
+
+; Gets heap statistics for the mem command (R0->ptr to HEAP_INFO)
+	.global getHeapInfo
+getHeapInfo:
+			   SVC	 #54
+			   BX LR
+
+; Gets a heap block in address order (R0->ptr to HEAP_BLOCK, R1->block num)
+	.global getHeapBlockInfo
+getHeapBlockInfo:
+			   SVC	 #55
+			   BX LR
+
+; Moves the stacks of stopped and unrun tasks down the heap, returns the number moved
+	.global compactStacks
+compactStacks:
+			   SVC	 #56
+			   BX LR
+
+; Writes n bytes to the console transmit pipe, blocking while it is full, returns the bytes written
+; (R0->buf, R1->n), retried like pipeWrite. Returns 0 when no transmit pipe is set
+	.global consoleWrite
+consoleWrite:
+			   PUSH	 {R4, R5}
+			   MOV	 R4, R0
+			   MOV	 R5, R1
+			   MOV	 R12, R1
+CONSOLE_WRITE:
+			   MOV	 R1, R4
+			   MOV	 R2, R5
+			   SVC	 #57
+			   ADD	 R4, R4, R0
+			   SUB	 R5, R5, R0
+			   CMP	 R1, #0
+			   BNE	 CONSOLE_WRITE
+			   SUB	 R0, R12, R5
+			   POP	 {R4, R5}
+			   BX LR
+
+; Reads up to n bytes from the console receive pipe, blocking until at least one is available,
+; returns the bytes read (R0->buf, R1->n), retried like pipeRead. Returns 0 when no receive pipe is set
+	.global consoleRead
+consoleRead:
+			   MOV	 R3, R0
+			   MOV	 R12, R1
+CONSOLE_READ:
+			   MOV	 R1, R3
+			   MOV	 R2, R12
+			   SVC	 #58
+			   CMP	 R1, #0
+			   BNE	 CONSOLE_READ
+			   BX LR
+
+; Reads one line (through its newline, at most n bytes) from the console receive pipe, blocking until
+; the receive interrupt delivers one (R0->buf, R1->n), returns the bytes read, 0 when no receive pipe is set
+	.global consoleReadLine
+consoleReadLine:
+			   MOV	 R3, R0
+			   MOV	 R12, R1
+CONSOLE_READ_LINE:
+			   MOV	 R1, R3
+			   MOV	 R2, R12
+			   SVC	 #59
+			   CMP	 R1, #0
+			   BNE	 CONSOLE_READ_LINE
+			   BX LR
+
+; Writes all n bytes to the console transmit pipe in one piece, blocking until there is room for them
+; (R0->buf, R1->n), returns false when no transmit pipe is set or n is larger than it
+	.global consoleWriteAll
+consoleWriteAll:
+			   MOV	 R3, R0
+			   MOV	 R12, R1
+CONSOLE_WRITE_ALL:
+			   MOV	 R1, R3
+			   MOV	 R2, R12
+			   SVC	 #60
+			   CMP	 R1, #0
+			   BNE	 CONSOLE_WRITE_ALL
+			   BX LR
+
+; Returns true in an unprivileged task (thread mode with TMPL set), false in handlers and privileged code
+	.global inUnprivilegedTask
+inUnprivilegedTask:
+			   MRS	 R0, IPSR
+			   CBNZ	 R0, IN_HANDLER
+			   MRS	 R0, CONTROL
+			   AND	 R0, R0, #1
+			   BX LR
+IN_HANDLER:
+			   MOV	 R0, #0
+			   BX LR
+
+;claims the log ring slot at head (R0, tail follows it) and advances head, wrapping at R1 records
+;returns the slot, or 0xFFFFFFFF when the ring is full. LDREX/STREX keep tasks and ISRs from sharing a slot.
+;every task can write head, so one outside the ring is treated as full and never returned
+	.global logReserve
+logReserve:
+			   LDREX R2, [R0]
+			   CMP	 R2, R1
+			   BHS	 LOG_FULL
+			   ADD	 R3, R2, #1
+			   CMP	 R3, R1
+			   BNE	 LOG_NO_WRAP
+			   MOV	 R3, #0
+LOG_NO_WRAP:
+			   LDR	 R12, [R0, #4]
+			   CMP	 R3, R12
+			   BEQ	 LOG_FULL
+			   STREX R12, R3, [R0]
+			   CMP	 R12, #0
+			   BNE	 logReserve
+			   MOV	 R0, R2
+			   BX LR
+LOG_FULL:
+			   CLREX
+			   MVN	 R0, #0
+			   BX LR
+
 .endm
@@ -0,0 +1,311 @@
+// Benchmark functions
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Hardware configuration:
+// Timer 1A is a free running 32-bit up counter at the system clock,
+// readable from unprivileged tasks through the peripheral MPU region
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "kernel.h"
+#include "asm.h"
+#include "uart0.h"
+#include "string.h"
+#include "shell.h"
+#include "bench.h"
+#include "kprintf.h"
+
+#define BUF_SIZE 32
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Starts timer 1A counting up from 0 at 40 MHz (wraps every ~107 s)
+void initBenchTimer(void)
+{
+    SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R1;
+    _delay_cycles(3);
+
+    TIMER1_CTL_R &= ~TIMER_CTL_TAEN;                    // turn-off timer before reconfiguring
+    TIMER1_CFG_R = TIMER_CFG_32_BIT_TIMER;              // configure as 32-bit timer (A+B)
+    TIMER1_TAMR_R = TIMER_TAMR_TAMR_PERIOD | TIMER_TAMR_TACDIR; // periodic, count up
+    TIMER1_TAILR_R = 0xFFFFFFFF;
+    TIMER1_TAV_R = 0;
+    TIMER1_CTL_R |= TIMER_CTL_TAEN;
+}
+
+// Returns the current cycle count (differences are valid across a wrap)
+uint32_t readBenchTimer(void)
+{
+    return TIMER1_TAV_R;
+}
+
+void printResult(const char label[], uint32_t cycles)
+{
+    kprintf("%s%u clks (%u us)\n", label, cycles, cycles / 40);
+}
+
+// Other half of the ping-pong benchmarks, answers semaphore pings then notification pings
+void benchPong(void)
+{
+    uint16_t i;
+    _handle ping = getHandle("benchPing");
+    _handle pong = getHandle("benchPong");
+    _handle shell = getTaskHandle("Shell");
+
+    while(true)
+    {
+        for(i = 0; i < BENCH_ROUNDS; i++)
+        {
+            wait(ping);
+            post(pong);
+        }
+        for(i = 0; i < BENCH_ROUNDS; i++)
+        {
+            takeNotification(true);
+            notify(shell, 1, NOTIFY_INCREMENT);
+        }
+    }
+}
+
+// Thread created and deleted by the churn benchmark (never gets to run)
+void benchWorker(void)
+{
+    while(true)
+        yield();
+}
+
+// Runs from the shell: creates and deletes threads with alternating stack sizes (single and multi-block),
+// and checks the heap ends where it started and the last cycles are no slower than the first
+void benchChurn(void)
+{
+    uint16_t i;
+    uint32_t start;
+    uint32_t cycles;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t heapBefore = getHeapFree();
+    uint32_t heapAfter;
+    bool ok = true;
+
+    for(i = 0; i < CHURN_ROUNDS && ok; i++)
+    {
+        start = readBenchTimer();
+        ok = spawnThread((uint32_t)benchWorker, "Churn", 7, (i & 1) ? 2048 : 512);
+        ok = ok && removeThread((uint32_t)benchWorker);
+        cycles = readBenchTimer() - start;
+
+        if(i < CHURN_WINDOW)
+            first += cycles;
+        else if(i >= CHURN_ROUNDS - CHURN_WINDOW)
+            last += cycles;
+    }
+    heapAfter = getHeapFree();
+
+    kprintf("Threads created/deleted: %u\n", ok ? i : i - 1);
+    printResult("First create+delete:     ", first / CHURN_WINDOW);
+    if(ok)
+        printResult("Last create+delete:      ", last / CHURN_WINDOW);
+
+    kprintf("Heap free before/after:  %u/%u%s\n", heapBefore, heapAfter, heapBefore == heapAfter ? " (no leak)" : " (LEAK)");
+}
+
+// Runs from the shell: compares round-trip latency of semaphore ping-pong against task notifications.
+// The pong task and its semaphores only exist for the run. Both tasks run at priority 0 under the priority
+// scheduler so other tasks do not run in between, the scheduler mode and the shell's priority are put back after
+void benchNotify(void)
+{
+    uint16_t i;
+    uint32_t start;
+    uint32_t semCycles;
+    uint32_t notifyCycles;
+    uint8_t shellPriority;
+    bool wasPriority;
+    _handle ping = createSemaphore(0, "benchPing");
+    _handle pong = createSemaphore(0, "benchPong");
+    _handle pongTask = INVALID_HANDLE;
+
+    if(ping != INVALID_HANDLE && pong != INVALID_HANDLE && spawnThread((uint32_t)benchPong, "BenchPong", 0, 512))
+        pongTask = getTaskHandle("BenchPong");
+
+    if(pongTask != INVALID_HANDLE)
+    {
+        shellPriority = changeThreadPriority((uint32_t)shell, 0);
+        wasPriority = setSchedPriority();
+
+        start = readBenchTimer();
+        for(i = 0; i < BENCH_ROUNDS; i++)
+        {
+            post(ping);
+            wait(pong);
+        }
+        semCycles = (readBenchTimer() - start) / BENCH_ROUNDS;
+
+        start = readBenchTimer();
+        for(i = 0; i < BENCH_ROUNDS; i++)
+        {
+            notify(pongTask, 1, NOTIFY_INCREMENT);
+            takeNotification(true);
+        }
+        notifyCycles = (readBenchTimer() - start) / BENCH_ROUNDS;
+
+        if(!wasPriority)
+            setSchedRoundRobin();
+        changeThreadPriority((uint32_t)shell, shellPriority);
+    }
+
+    // the pong task is waiting on benchPing again, it has to go before the semaphores can
+    removeThread((uint32_t)benchPong);
+    deleteObject(ping);
+    deleteObject(pong);
+
+    if(pongTask == INVALID_HANDLE)
+    {
+        putsUart0("Could not create BenchPong\n");
+        return;
+    }
+    printResult("Semaphore round trip:    ", semCycles);
+    printResult("Notification round trip: ", notifyCycles);
+}
+
+// Prints one row of the heap latency histogram
+void printLatency(const char label[], HEAP_LATENCY* latency, uint8_t op)
+{
+    uint8_t i;
+
+    kprintf("%s%u calls, min %u avg %u max %u clks\n  ", label, latency->calls[op], latency->min[op],
+            latency->calls[op] ? latency->total[op] / latency->calls[op] : 0, latency->max[op]);
+
+    for(i = 0; i < HEAP_LATENCY_BUCKETS; i++)
+    {
+        kprintf("%s%u:%u ", i < HEAP_LATENCY_BUCKETS - 1 ? "<" : ">=", 32 << (i < HEAP_LATENCY_BUCKETS - 1 ? i : i - 1),
+                latency->buckets[op][i]);
+    }
+    putcUart0('\n');
+}
+
+// Runs from the shell: times random heap allocations and frees in the kernel on top of the
+// running tasks' stacks, and prints the spread of clocks per call
+void benchHeap(void)
+{
+    HEAP_LATENCY latency;
+    uint32_t heapBefore = getHeapFree();
+
+    if(!timeHeap(&latency))
+    {
+        putsUart0("Heap benchmark failed\n");
+        return;
+    }
+
+    printLatency("mallocFromHeap: ", &latency, 0);
+    printLatency("freeToHeap:     ", &latency, 1);
+
+    kprintf("Failed allocations:      %u\n", latency.failed);
+    kprintf("Heap free before/after:  %u/%u\n", heapBefore, getHeapFree());
+}
+
+// Runs from the shell: times spawnThread alone (SVC, heap allocation, srd masks, stack paint)
+// for a range of stack sizes, deleting each thread outside the timed part
+void benchCreate(void)
+{
+    uint16_t i;
+    uint8_t j;
+    uint32_t start;
+    uint32_t cycles;
+    uint32_t sizes[] = {512, 1024, 2048, 4096};
+
+    for(j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+    {
+        cycles = 0;
+        for(i = 0; i < CREATE_ROUNDS; i++)
+        {
+            start = readBenchTimer();
+            if(!spawnThread((uint32_t)benchWorker, "Create", 7, sizes[j]))
+                break;
+            cycles += readBenchTimer() - start;
+            removeThread((uint32_t)benchWorker);
+        }
+
+        kprintf("createThread %u", sizes[j]);
+        if(i < CREATE_ROUNDS)
+        {
+            putsUart0(": out of memory\n");
+            continue;
+        }
+        printResult(" byte stack: ", cycles / CREATE_ROUNDS);
+    }
+}
+
+// Appends to a line the way ps used to build its output, through itoa's buffer and strcpy
+void appendString(char line[], uint8_t* length, const char str[])
+{
+    strcpy(line + *length, str);
+    while(line[*length] != '\0')
+        (*length)++;
+}
+
+// Runs from the shell: formats a ps record into memory PRINT_ROUNDS times with the itoa/iftoa/strcpy chain
+// ps was built from and with ksnprintf, then times a whole ps to the console
+void benchPrint(void)
+{
+    TASK_INFO task;
+    char line[PRINT_LINE];
+    char str[BUF_SIZE] = {0};
+    uint8_t length = 0;
+    uint16_t i;
+    uint32_t start;
+    uint32_t chainCycles;
+    uint32_t formatCycles;
+    uint32_t psCycles;
+
+    if(!getTaskInfo((void *)&task, 0))
+        return;
+
+    start = readBenchTimer();
+    for(i = 0; i < PRINT_ROUNDS; i++)
+    {
+        length = 0;
+        appendString(line, &length, task.name);
+        appendString(line, &length, "\n\tPid: ");
+        appendString(line, &length, itoa(task.pid, str));
+        appendString(line, &length, "\n\tStack: ");
+        appendString(line, &length, itoa(task.stackUsed, str));
+        appendString(line, &length, "/");
+        appendString(line, &length, itoa(task.stackBytes, str));
+        appendString(line, &length, " bytes\n\tCPU Usage: ");
+        appendString(line, &length, iftoa(task.cpuUsage, 2, 2, str));
+        appendString(line, &length, "%\n");
+    }
+    chainCycles = (readBenchTimer() - start) / PRINT_ROUNDS;
+
+    start = readBenchTimer();
+    for(i = 0; i < PRINT_ROUNDS; i++)
+    {
+        ksnprintf(line, sizeof(line), "%s\n\tPid: %u\n\tStack: %u/%u bytes\n\tCPU Usage: %.2u%%\n", task.name, task.pid,
+                  task.stackUsed, task.stackBytes, task.cpuUsage);
+    }
+    formatCycles = (readBenchTimer() - start) / PRINT_ROUNDS;
+
+    // let earlier output drain so ps starts with an empty transmit pipe
+    sleep(100);
+    start = readBenchTimer();
+    ps();
+    psCycles = readBenchTimer() - start;
+
+    kprintf("\nps record, itoa chain:   %u clks (%u bytes)\n", chainCycles, length);
+    kprintf("ps record, ksnprintf:    %u clks\n", formatCycles);
+    kprintf("ps to console:           %u clks (%u us)\n", psCycles, psCycles / 40);
+}
@@ -0,0 +1,51 @@
+// Benchmark functions
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+
+// round trips per measurement
+#define BENCH_ROUNDS 1000
+
+// thread create/delete cycles, and the number averaged at the start and end to spot a slowdown
+#define CHURN_ROUNDS 5000
+#define CHURN_WINDOW 100
+
+// thread creates timed for each stack size by the create benchmark
+#define CREATE_ROUNDS 100
+
+// ps records formatted by the print benchmark, and the room for one
+#define PRINT_ROUNDS 100
+#define PRINT_LINE   96
+
+// random heap calls timed by timeHeap(), the most allocations held at once,
+// and the calls the kernel makes per SVC (SysTick is held off for each chunk)
+#define HEAP_BENCH_ROUNDS 2000
+#define HEAP_BENCH_SLOTS  8
+#define HEAP_BENCH_CHUNK  20
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initBenchTimer(void);
+uint32_t readBenchTimer(void);
+
+void benchPong(void);
+void benchNotify(void);
+void benchWorker(void);
+void benchChurn(void);
+void benchHeap(void);
+void benchCreate(void);
+void benchPrint(void);
+
+#endif
@@ -19,9 +19,8 @@
 #include "string.h"
 #include "kernel.h"
 #include "uart0.h"
-
-#define NUM_SRAM_REGIONS 5
-#define BUF_SIZE 32
+#include "kprintf.h"
+#include "log.h"
 
 //-----------------------------------------------------------------------------
 // Subroutines
@@ -34,80 +33,30 @@
 void mpuFaultIsr(void)
 {
     uint32_t pid = getCurrentPid();
-    char str[BUF_SIZE] = {0};
-
-    putsUart0("MPU fault in process ");
-    putsUart0(itoa(pid, str));
-    putcUart0('\n');
-
     uint32_t* psp = getPSP();
     uint32_t* msp = getMSP();
 
-    putsUart0("PSP: ");
-    putsUart0(itohex((uint32_t) psp, str));
-    putcUart0('\n');
+    // one line now, the rest goes through the log so the fault doesn't wait on the UART
+    kprintf("%s in process %u\n", isStackOverflow() ? "Stack overflow" : "MPU fault", pid);
+    LOG2("MPU fault in process %u, flags 0x%02X", pid, NVIC_FAULT_STAT_R & 0xFF);
+    LOG2("PSP: 0x%08X MSP: 0x%08X", (uint32_t)psp, (uint32_t)msp);
 
-    putsUart0("MSP: ");
-    putsUart0(itohex((uint32_t)msp, str));
-    putcUart0('\n');
-
-    putsUart0("Flags: ");
-    // gets lower 8 bits of FAULTSTAT register, which contains mpu fault flags
-    putsUart0(itohex(NVIC_FAULT_STAT_R & 0xFF, str));
-    putcUart0('\n');
-
-    putsUart0("At instruction: ");
-    if(NVIC_FAULT_STAT_R & (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR)) //if deer or ierr, pc has instr.
-        putsUart0(itohex(*(psp + 6), str));
+    //if deer or ierr, pc has instr.
+    if(NVIC_FAULT_STAT_R & (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR))
+        LOG1("At instruction: 0x%08X", *(psp + 6));
     else
-        putsUart0("Unknown");
-
-    putcUart0('\n');
+        LOG0("At instruction: Unknown");
 
-    putsUart0("At address: ");
     // If mmarv bit is set, mmaddr reg contains valid address, else unknown
     if(NVIC_FAULT_STAT_R & NVIC_FAULT_STAT_MMARV)
-        putsUart0(itohex(NVIC_MM_ADDR_R, str));
+        LOG1("At address: 0x%08X", NVIC_MM_ADDR_R);
     else
-        putsUart0("Unknown");
-    putcUart0('\n');
-    putcUart0('\n');
-
-    putsUart0("---Process Stack Dump---\n\n");
-
-
-    putsUart0("R0: ");
-    putsUart0(itohex(*psp, str));
-    putcUart0('\n');
-
-    putsUart0("R1: ");
-    putsUart0(itohex(*(psp + 1), str));
-    putcUart0('\n');
-
-    putsUart0("R2: ");
-    putsUart0(itohex(*(psp + 2), str));
-    putcUart0('\n');
+        LOG0("At address: Unknown");
 
-    putsUart0("R3: ");
-    putsUart0(itohex(*(psp + 3), str));
-    putcUart0('\n');
-
-    putsUart0("R12: ");
-    putsUart0(itohex(*(psp + 4), str));
-    putcUart0('\n');
-
-    putsUart0("LR: ");
-    putsUart0(itohex(*(psp + 5), str));
-    putcUart0('\n');
-
-    putsUart0("PC: ");
-    putsUart0(itohex(*(psp + 6), str));
-    putcUart0('\n');
-
-    putsUart0("xPSR: ");
-    putsUart0(itohex(*(psp + 7), str));
-    putcUart0('\n');
-    putcUart0('\n');
+    LOG2("R0: 0x%08X R1: 0x%08X", *psp, *(psp + 1));
+    LOG2("R2: 0x%08X R3: 0x%08X", *(psp + 2), *(psp + 3));
+    LOG2("R12: 0x%08X LR: 0x%08X", *(psp + 4), *(psp + 5));
+    LOG2("PC: 0x%08X xPSR: 0x%08X", *(psp + 6), *(psp + 7));
 
     // Clear memory management fault pending bit
     NVIC_SYS_HND_CTRL_R &= ~(NVIC_SYS_HND_CTRL_MEMP);
@@ -120,27 +69,10 @@ void mpuFaultIsr(void)
 void hardFaultIsr(void)
 {
     uint32_t pid = getCurrentPid();
-    char str[BUF_SIZE] = {0};
-
-    putsUart0("Hard fault in process ");
-    putsUart0(itoa(pid, str));
-    putcUart0('\n');
-
-    uint32_t psp = (uint32_t)getPSP();
-    uint32_t msp = (uint32_t)getMSP();
-
-    putsUart0("PSP: ");
-    putsUart0(itohex(psp, str));
-    putcUart0('\n');
-
-    putsUart0("MSP: ");
-    putsUart0(itohex(msp, str));
-    putcUart0('\n');
-
-    putsUart0("Flags: ");
-    putsUart0(itohex(NVIC_HFAULT_STAT_R, str));
-    putsUart0("\n\n");
 
+    kprintf("Hard fault in process %u\n", pid);
+    kprintf("PSP: 0x%08X\nMSP: 0x%08X\n", (uint32_t)getPSP(), (uint32_t)getMSP());
+    kprintf("Flags: 0x%08X\n\n", NVIC_HFAULT_STAT_R);
 
     while(1)
     {
@@ -151,12 +83,8 @@ void hardFaultIsr(void)
 void busFaultIsr(void)
 {
     uint32_t pid = getCurrentPid();
-    char str[BUF_SIZE] = {0};
 
-    putsUart0("Bus fault in process ");
-    putsUart0(itoa(pid, str));
-    putcUart0('\n');
-    putcUart0('\n');
+    kprintf("Bus fault in process %u\n\n", pid);
 
     while(1)
     {
@@ -167,15 +95,10 @@ void busFaultIsr(void)
 void usageFaultIsr(void)
 {
     uint32_t pid = getCurrentPid();
-    char str[BUF_SIZE] = {0};
 
-    putsUart0("Usage fault in process ");
-    putsUart0(itoa(pid, str));
-    putcUart0('\n');
-    putcUart0('\n');
+    kprintf("Usage fault in process %u\n\n", pid);
 
     while(1)
     {
     }
 }
-
@@ -20,31 +20,146 @@
 #include "string.h"
 #include "uart0.h"
 #include "asm.h"
+#include "pool.h"
+#include "log.h"
 
 //-----------------------------------------------------------------------------
 // RTOS Defines and Kernel Variables
 //-----------------------------------------------------------------------------
 
+// size of the names kept for tasks and kernel objects, including the terminator
+#define NAME_BYTES 16
+
+// wait queue, linked through tcb[].next
+#define NO_TASK 0xFF
+
+typedef struct _waitQueue
+{
+    uint8_t head;                  // first task to be woken
+    uint8_t tail;                  // last task queued
+} waitQueue;
+
 // mutex
 typedef struct _mutex
 {
-    char name[16];
     bool lock;
-    uint8_t queueSize;
-    uint8_t processQueue[MAX_MUTEX_QUEUE_SIZE];
+    bool recursive;                // owner may lock again, unlocking once per lock
+    uint8_t depth;                 // times the owner has locked it
     uint8_t lockedBy;
+    waitQueue queue;
 } mutex;
-mutex mutexes[MAX_MUTEXES];
 
 // semaphore
 typedef struct _semaphore
 {
-    char name[16];
     uint8_t count;
-    uint8_t queueSize;
-    uint8_t processQueue[MAX_SEMAPHORE_QUEUE_SIZE];
+    waitQueue queue;
 } semaphore;
-semaphore semaphores[MAX_SEMAPHORES];
+
+// reader-writer lock (writer preference)
+typedef struct _rwlock
+{
+    uint8_t readers;               // number of tasks holding read access
+    uint32_t readerMask;           // bit per task holding read access
+    bool write;                    // a writer holds the lock
+    uint8_t writer;                // task holding write access
+    waitQueue readQueue;
+    waitQueue writeQueue;
+} rwlock;
+
+// condition variable
+typedef struct _condition
+{
+    waitQueue queue;
+} condition;
+
+// event flags
+typedef struct _event
+{
+    uint32_t flags;
+    waitQueue queue;
+} event;
+
+// shared memory region (granted through the tasks' srd masks, or the read-only window)
+typedef struct _sharedRegion
+{
+    void* base;
+    uint32_t size;
+    uint8_t owner;                 // task that created the region, always has read-write access
+    uint32_t readers;              // bit per task with read-only access
+    uint32_t writers;              // bit per task with read-write access
+} sharedRegion;
+
+// byte-stream pipe, circular buffer allocated from the heap
+typedef struct _pipe
+{
+    uint8_t* buffer;
+    uint16_t size;
+    uint16_t head;                 // next byte to read
+    uint16_t count;                // bytes waiting to be read
+    waitQueue readQueue;           // tasks waiting for data
+    waitQueue writeQueue;          // tasks waiting for space
+} pipe;
+
+// barrier, releases its tasks once count of them have arrived
+typedef struct _barrier
+{
+    uint8_t count;                 // tasks that must arrive
+    uint8_t arrived;               // tasks waiting in the current phase
+    uint32_t phase;                // phases completed
+    waitQueue queue;
+} barrier;
+
+// software timer, linked into a slot of the timer wheel while active
+typedef struct _timer
+{
+    _timerFn callback;
+    uint32_t arg;
+    uint32_t interval;             // ticks from start to expiry, and between periodic expiries
+    uint32_t rounds;               // passes over its slot left before it expires
+    uint32_t overruns;             // expiries dropped because the daemon had not run the previous one
+    bool periodic;
+    bool active;                   // linked into the wheel
+    bool pending;                  // queued for the timer daemon
+    uint8_t slot;
+    uint8_t next;                  // timers in the same slot
+    uint8_t prev;
+} timer;
+
+// kernel object pool
+typedef struct _kernelObject
+{
+    uint8_t type;                  // see OBJECT_ values in kernel.h
+    uint8_t generation;            // bumped on every allocation to invalidate stale handles
+    char name[NAME_BYTES];
+    union
+    {
+        mutex mtx;
+        semaphore sem;
+        rwlock rw;
+        condition cond;
+        event evt;
+        sharedRegion shm;
+        pipe pip;
+        barrier bar;
+        timer tmr;
+    } obj;
+} kernelObject;
+kernelObject objects[MAX_KERNEL_OBJECTS];
+
+#define HANDLE_INDEX(h)      ((h) & 0xFF)
+#define HANDLE_GENERATION(h) (((h) >> 8) & 0xFF)
+#define MAKE_HANDLE(i)       (((_handle)objects[i].generation << 8) | (i))
+#define MAKE_TASK_HANDLE(i)  (((_handle)tcb[i].generation << 8) | (i))
+#define NO_OBJECT            0xFF
+
+// software timers, a hashed wheel indexed by expiry tick so start, stop and each tick are O(1)
+uint32_t timerTicks = 0;                        // ticks since start
+uint8_t timerWheel[TIMER_WHEEL_SLOTS];          // first timer in each slot
+uint8_t expiredTimers[MAX_KERNEL_OBJECTS];      // timers waiting for the daemon to run their callback
+uint8_t expiredHead = 0;
+uint8_t expiredCount = 0;
+uint8_t timerDaemonTask = NO_TASK;              // daemon task while it waits for a timer
 
 // task
 uint8_t taskCount = 0;            // total number of valid tasks
@@ -58,7 +173,7 @@ uint32_t clkSum = 0;
 
 #define PERIOD_MS 1000            // 10000000 clks
 #define PERIOD_CLKS 40000000
-#define BUF_SIZE 32
+#define CPU_USAGE_CLKS (PERIOD_CLKS / 10000) // clocks per 0.01% of a period
 
 // control
 bool priorityScheduler = false;   // priority (true) or round-robin (false)
@@ -78,9 +193,18 @@ struct _tcb
     uint8_t currentPriority;       // 0=highest (needed for pi)
     uint32_t ticks;                // ticks until sleep complete
     uint8_t srd[NUM_SRAM_REGIONS]; // MPU subregion disable bits
-    char name[16];                 // name of task used in ps command
-    uint8_t mutex;                 // index of the mutex in use or blocking the thread
-    uint8_t semaphore;             // index of the semaphore that is blocking the thread
+    uint32_t stackBytes;           // size of the stack below spInit
+    uint32_t heapBytes;            // size of the private heap at spInit (0 = none)
+    uint32_t guardBytes;           // size of the guard subregion below the stack (0 = none)
+    uint32_t stackPeak;            // most stack seen in use, in bytes (see getStackPeak)
+    uint32_t window[2];            // read-only window region base and attributes (attributes 0 = closed)
+    char name[NAME_BYTES];         // name of task used in ps command
+    uint8_t blockedOn;             // index of the kernel object blocking the thread
+    uint8_t next;                  // next task in the wait queue the thread is blocked on
+    uint8_t relock;                // index of the mutex to reacquire when a condition wakes the thread
+    uint32_t eventMask;            // event flags the thread is waiting for
+    uint32_t notification;         // notification word set by notify()
+    uint8_t generation;            // bumped when the record is reused to invalidate stale task handles
     uint32_t clocks[2];             // clocks for keeping cpu usage (one sampling, one stable)
 } tcb[MAX_TASKS];
 
@@ -94,8 +218,8 @@ uint8_t taskCurrentForPriority[NUM_PRIORITIES]; // Tracks last task run on each
 #define WAIT        4
 #define POST        5
 #define PIDOF       6
-#define MUT         7
-#define SEM         8
+#define OBJ_INFO    7
+#define HANDLE      8
 #define PS          9
 #define RUN         10
 #define KILL        11
@@ -104,33 +228,1095 @@ uint8_t taskCurrentForPriority[NUM_PRIORITIES]; // Tracks last task run on each
 #define SCHED_PRIO  14
 #define SCHED_RR    15
 #define SET_PRIO    16
+#define CREATE_MUT  17
+#define CREATE_SEM  18
+#define DELETE_OBJ  19
+#define READ_LOCK   20
+#define READ_UNLOCK 21
+#define WRITE_LOCK  22
+#define WRITE_UNLOCK 23
+#define CREATE_RW   24
+#define COND_WAIT   25
+#define COND_SIGNAL 26
+#define COND_BCAST  27
+#define CREATE_COND 28
+#define EVENT_WAIT  29
+#define EVENT_SET   30
+#define CREATE_EVT  31
+#define NOTIFY      32
+#define NOTIFY_TAKE 33
+#define TASK_HANDLE 34
+#define CREATE_SHM  35
+#define GRANT_SHM   36
+#define MAP_SHM     37
+#define CREATE_PIPE 38
+#define PIPE_WRITE  39
+#define PIPE_READ   40
+#define CREATE_RMUT 41
+#define BARRIER_WAIT 42
+#define CREATE_BAR  43
+#define CREATE_TMR  44
+#define TIMER_START 45
+#define TIMER_STOP  46
+#define TIMER_RESET 47
+#define TIMER_TAKE  48
+#define SPAWN       49
+#define DELETE      50
+#define HEAP_FREE   51
+#define HEAP_BENCH  52
+#define TASK_HEAP_PTR 53
+#define HEAP_STATS  54
+#define HEAP_MAP    55
+#define COMPACT     56
+#define CONSOLE_WRITE 57
+#define CONSOLE_READ  58
+#define CONSOLE_READ_LINE 59
+#define CONSOLE_WRITE_ALL 60
+
+// BASEPRI value that masks every exception allowed to touch kernel state
+#define KERNEL_BASEPRI (KERNEL_INT_PRIORITY << 5)
+
+// fills unused stack so the high-water mark can be found
+#define STACK_PAINT 0xA5A5A5A5
 
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
-bool initMutex(uint8_t mutex, const char name[])
+// Adds a task to the back of a wait queue
+void enqueueTask(waitQueue* queue, uint8_t task)
+{
+    tcb[task].next = NO_TASK;
+    if(queue->head == NO_TASK)
+        queue->head = task;
+    else
+        tcb[queue->tail].next = task;
+    queue->tail = task;
+}
+
+// Removes the task at the front of a wait queue, returns NO_TASK if empty
+uint8_t dequeueTask(waitQueue* queue)
+{
+    uint8_t task = queue->head;
+    if(task != NO_TASK)
+        queue->head = tcb[task].next;
+    return task;
+}
+
+// Removes a task from anywhere in a wait queue
+void removeTask(waitQueue* queue, uint8_t task)
+{
+    uint8_t prev = NO_TASK;
+    uint8_t i = queue->head;
+
+    while(i != NO_TASK && i != task)
+    {
+        prev = i;
+        i = tcb[i].next;
+    }
+
+    if(i == NO_TASK)
+        return;
+
+    if(prev == NO_TASK)
+        queue->head = tcb[task].next;
+    else
+        tcb[prev].next = tcb[task].next;
+
+    if(queue->tail == task)
+        queue->tail = prev;
+}
+
+// Copies the names of the tasks in a wait queue, returns the number of waiters
+uint8_t getWaiterNames(waitQueue* queue, char waiters[][16])
+{
+    uint8_t n = 0;
+    uint8_t i;
+
+    for(i = queue->head; i != NO_TASK && n < MAX_TASKS; i = tcb[i].next)
+        strcpy(waiters[n++], tcb[i].name);
+
+    return n;
+}
+
+// Allocates a kernel object from the pool, returns its handle or INVALID_HANDLE if the pool is full
+_handle allocObject(uint8_t type, const char name[])
+{
+    uint8_t i;
+
+    for(i = 0; i < MAX_KERNEL_OBJECTS; i++)
+    {
+        if(objects[i].type == OBJECT_FREE)
+        {
+            // generation 0 is never used so a handle is never INVALID_HANDLE
+            if(++objects[i].generation == 0)
+                objects[i].generation = 1;
+            objects[i].type = type;
+            strncpy(objects[i].name, name, sizeof(objects[i].name));
+            return MAKE_HANDLE(i);
+        }
+    }
+    return INVALID_HANDLE;
+}
+
+// O(1) handle to object lookup, returns NULL if the handle is stale or of another type
+kernelObject* getObject(_handle handle, uint8_t type)
+{
+    uint8_t i = HANDLE_INDEX(handle);
+
+    if(i < MAX_KERNEL_OBJECTS && objects[i].type == type && objects[i].generation == HANDLE_GENERATION(handle))
+        return &objects[i];
+    return NULL;
+}
+
+_handle initMutex(const char name[])
+{
+    _handle handle = allocObject(OBJECT_MUTEX, name);
+    kernelObject* object = getObject(handle, OBJECT_MUTEX);
+
+    if(object != NULL)
+    {
+        object->obj.mtx.lock = false;
+        object->obj.mtx.recursive = false;
+        object->obj.mtx.depth = 0;
+        object->obj.mtx.lockedBy = 0;
+        object->obj.mtx.queue.head = NO_TASK;
+    }
+    return handle;
+}
+
+_handle initRecursiveMutex(const char name[])
+{
+    _handle handle = initMutex(name);
+    kernelObject* object = getObject(handle, OBJECT_MUTEX);
+
+    if(object != NULL)
+        object->obj.mtx.recursive = true;
+    return handle;
+}
+
+_handle initSemaphore(uint8_t count, const char name[])
+{
+    _handle handle = allocObject(OBJECT_SEMAPHORE, name);
+    kernelObject* object = getObject(handle, OBJECT_SEMAPHORE);
+
+    if(object != NULL)
+    {
+        object->obj.sem.count = count;
+        object->obj.sem.queue.head = NO_TASK;
+    }
+    return handle;
+}
+
+_handle initRwLock(const char name[])
+{
+    _handle handle = allocObject(OBJECT_RWLOCK, name);
+    kernelObject* object = getObject(handle, OBJECT_RWLOCK);
+
+    if(object != NULL)
+    {
+        object->obj.rw.readers = 0;
+        object->obj.rw.readerMask = 0;
+        object->obj.rw.write = false;
+        object->obj.rw.readQueue.head = NO_TASK;
+        object->obj.rw.writeQueue.head = NO_TASK;
+    }
+    return handle;
+}
+
+_handle initCondition(const char name[])
+{
+    _handle handle = allocObject(OBJECT_CONDITION, name);
+    kernelObject* object = getObject(handle, OBJECT_CONDITION);
+
+    if(object != NULL)
+        object->obj.cond.queue.head = NO_TASK;
+    return handle;
+}
+
+_handle initEvent(const char name[])
+{
+    _handle handle = allocObject(OBJECT_EVENT, name);
+    kernelObject* object = getObject(handle, OBJECT_EVENT);
+
+    if(object != NULL)
+    {
+        object->obj.evt.flags = 0;
+        object->obj.evt.queue.head = NO_TASK;
+    }
+    return handle;
+}
+
+// Returns the heap block holding a task's guard, stack and private heap
+void* getStackBlock(uint8_t task)
+{
+    return (uint8_t *)tcb[task].spInit - tcb[task].stackBytes - tcb[task].guardBytes;
+}
+
+// Builds the srd masks for a task's block, leaving the guard subregion at its bottom disabled so an
+// overflow faults in the task instead of reaching the block below, and enabling the log ring every
+// task writes. Returns the size of the block
+uint32_t generateTaskSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS], void* block, uint32_t guardBytes)
+{
+    uint8_t otherMask[NUM_SRAM_REGIONS];
+    uint32_t blockBytes = generateHeapSrdMasks(srdMask, block);
+    uint8_t i;
+
+    if(guardBytes != 0)
+    {
+        generateSramSrdMasks(otherMask, block, guardBytes);
+        for(i = 0; i < NUM_SRAM_REGIONS; i++)
+            srdMask[i] |= ~otherMask[i];
+    }
+    generateSramSrdMasks(otherMask, (void *)LOG_BASE, LOG_BYTES);
+    for(i = 0; i < NUM_SRAM_REGIONS; i++)
+        srdMask[i] &= otherMask[i];
+    return blockBytes;
+}
+
+// Checks whether the running task's memory fault came from running off the bottom of its stack:
+// a fault while stacking an exception frame, an access in its guard, or a psp below its stack
+bool isStackOverflow(void)
+{
+    uint32_t bottom = (uint32_t)tcb[taskCurrent].spInit - tcb[taskCurrent].stackBytes;
+
+    if(NVIC_FAULT_STAT_R & NVIC_FAULT_STAT_MSTKE)
+        return true;
+    if((NVIC_FAULT_STAT_R & NVIC_FAULT_STAT_MMARV) && NVIC_MM_ADDR_R >= bottom - tcb[taskCurrent].guardBytes && NVIC_MM_ADDR_R < bottom)
+        return true;
+    return (uint32_t)getPSP() < bottom;
+}
+
+// Logs and stops the running task when its saved context went below the bottom of its stack.
+// Called from PendSV, which already holds off the kernel priority, so the report is a log record
+// instead of waiting on the UART
+void stopOverflowedThread(void)
+{
+    LOG1("Stack overflow in process %u", (uint32_t)tcb[taskCurrent].pid);
+    stopThread((_fn)tcb[taskCurrent].pid);
+}
+
+// Rebuilds a task's srd masks from its stack and the shared regions it may write,
+// and its read-only window from the shared region it may only read
+void updateTaskAccess(uint8_t task)
+{
+    uint8_t i;
+    uint8_t j;
+    uint8_t srdMask[NUM_SRAM_REGIONS];
+    sharedRegion* shm;
+
+    generateTaskSrdMasks(tcb[task].srd, getStackBlock(task), tcb[task].guardBytes);
+    tcb[task].window[1] = 0;
+
+    for(i = 0; i < MAX_KERNEL_OBJECTS; i++)
+    {
+        if(objects[i].type != OBJECT_SHARED)
+            continue;
+
+        shm = &objects[i].obj.shm;
+        if(shm->writers & (1 << task))
+        {
+            generateHeapSrdMasks(srdMask, shm->base);
+            for(j = 0; j < NUM_SRAM_REGIONS; j++)
+                tcb[task].srd[j] &= srdMask[j];
+        }
+        else if(shm->readers & (1 << task))
+        {
+            generateReadOnlyWindow(tcb[task].window, shm->base, shm->size);
+        }
+    }
+}
+
+// Returns the most stack a task has used. The stack is painted when the thread is created, so the mark
+// is the lowest word that lost its paint, found scanning up from the bottom (locals that were only partly
+// written leave paint inside the used part). Everything above the last mark or the saved sp is known to be
+// used, so the scan stops there
+uint32_t getStackPeak(uint8_t task)
+{
+    uint32_t* base = (uint32_t *)((uint8_t *)tcb[task].spInit - tcb[task].stackBytes);
+    uint32_t* limit = (uint32_t *)((uint8_t *)tcb[task].spInit - tcb[task].stackPeak);
+    uint32_t* word = base;
+
+    if((uint32_t *)tcb[task].sp < limit && (uint32_t *)tcb[task].sp >= base)
+        limit = (uint32_t *)tcb[task].sp;
+
+    while(word < limit && *word == STACK_PAINT)
+        word++;
+
+    tcb[task].stackPeak = (uint8_t *)tcb[task].spInit - (uint8_t *)word;
+    return tcb[task].stackPeak;
+}
+
+// Names what a heap block holds: a task's stack, a shared region or a pipe buffer
+void getHeapOwner(uint32_t base, char owner[])
+{
+    uint8_t i;
+
+    for(i = 0; i < MAX_TASKS; i++)
+    {
+        if(tcb[i].state != STATE_INVALID && (uint32_t)getStackBlock(i) == base)
+        {
+            strcpy(owner, tcb[i].name);
+            return;
+        }
+    }
+    for(i = 0; i < MAX_KERNEL_OBJECTS; i++)
+    {
+        if((objects[i].type == OBJECT_SHARED && (uint32_t)objects[i].obj.shm.base == base)
+           || (objects[i].type == OBJECT_PIPE && (uint32_t)objects[i].obj.pip.buffer == base))
+        {
+            strcpy(owner, objects[i].name);
+            return;
+        }
+    }
+    strcpy(owner, "Kernel");
+}
+
+// Checks that the running task may access a buffer it handed to the kernel: flash, or SRAM the task
+// has enabled (kernel SRAM, peripherals and the bit-band aliases never are)
+bool verifyTaskBuffer(void* buffer, uint32_t size)
+{
+    uint8_t srdMask[NUM_SRAM_REGIONS];
+    uint32_t start = (uint32_t)buffer;
+    uint32_t end = start + size;
+
+    if(end < start)
+        return false;
+    if(end <= FLASH_TOP)
+        return true;
+    if(start < SRAM_BASE + KERNEL_SRAM_BYTES || end > SRAM_TOP)
+        return false;
+
+    generateSramSrdMasks(srdMask, buffer, size);
+    return verifyAccess(srdMask, tcb[taskCurrent].srd);
+}
+
+// Copies a name a task handed to the kernel into name (cut to the NAME_BYTES - 1 characters tasks and
+// objects keep), returns false if it is NULL or runs into memory the task can't read. Access is checked
+// again at each HEAP_UNIT boundary, the granularity of the task's srd masks
+bool copyTaskName(char name[NAME_BYTES], const char* str)
+{
+    uint8_t i;
+
+    if(str == NULL)
+        return false;
+
+    for(i = 0; i < NAME_BYTES - 1; i++)
+    {
+        if((i == 0 || (uint32_t)(str + i) % HEAP_UNIT == 0) && !verifyTaskBuffer((void *)(str + i), 1))
+            return false;
+        name[i] = str[i];
+        if(name[i] == '\0')
+            return true;
+    }
+    name[i] = '\0';
+    return true;
+}
+
+// Reprograms the MPU for the running task after its access changed
+void applyTaskAccess(void)
+{
+    applySramSrdMasks(tcb[taskCurrent].srd);
+    applyReadOnlyWindow(tcb[taskCurrent].window);
+}
+
+// Allocates a shared region (a whole buddy block, of HEAP_UNIT or more) from the heap, the owner gets read-write access
+_handle initShared(uint32_t size, uint8_t owner, const char name[])
+{
+    _handle handle = allocObject(OBJECT_SHARED, name);
+    kernelObject* object = getObject(handle, OBJECT_SHARED);
+    uint8_t srdMask[NUM_SRAM_REGIONS];
+    void* base;
+
+    if(object == NULL)
+        return INVALID_HANDLE;
+
+    base = mallocFromHeap(size);
+    if(base == NULL)
+    {
+        object->type = OBJECT_FREE;
+        return INVALID_HANDLE;
+    }
+
+    // writers get the whole buddy block, so readers' windows and ipcs use its size too
+    object->obj.shm.base = base;
+    object->obj.shm.size = generateHeapSrdMasks(srdMask, base);
+    object->obj.shm.owner = owner;
+    object->obj.shm.readers = 0;
+    object->obj.shm.writers = 1 << owner;
+    updateTaskAccess(owner);
+    return handle;
+}
+
+// Changes a task's access to a shared region (see SHARED_ values). Read-only access fails if the task
+// already has a read-only region, if the region cannot be mapped by the window, or if the task's own
+// subregions already cover it. The owner keeps read-write access
+bool setSharedAccess(sharedRegion* shm, uint8_t task, uint8_t access)
 {
-    bool ok = (mutex < MAX_MUTEXES);
-    if (ok)
+    uint32_t bit = 1 << task;
+    uint32_t readers = shm->readers;
+    uint32_t writers = shm->writers;
+    uint32_t window[2];
+    uint8_t srdMask[NUM_SRAM_REGIONS];
+    uint8_t i;
+    bool ok = true;
+
+    if(task == shm->owner && access != SHARED_READ_WRITE)
+        return false;
+
+    shm->readers &= ~bit;
+    shm->writers &= ~bit;
+
+    if(access == SHARED_READ)
+    {
+        updateTaskAccess(task);
+        ok = (tcb[task].window[1] == 0) && generateReadOnlyWindow(window, shm->base, shm->size);
+
+        generateSramSrdMasks(srdMask, shm->base, shm->size);
+        for(i = 0; i < NUM_SRAM_REGIONS; i++)
+            ok &= ((tcb[task].srd[i] | srdMask[i]) == 0xFF);
+
+        if(ok)
+            shm->readers |= bit;
+    }
+    else if(access == SHARED_READ_WRITE)
+    {
+        shm->writers |= bit;
+    }
+
+    if(!ok)
     {
-        mutexes[mutex].lock = false;
-        mutexes[mutex].lockedBy = 0;
-        strcpy(mutexes[mutex].name, name);
+        shm->readers = readers;
+        shm->writers = writers;
     }
+    updateTaskAccess(task);
     return ok;
 }
 
-bool initSemaphore(uint8_t semaphore, uint8_t count, const char name[])
+// Allocates a pipe with its buffer taken from the heap
+_handle initPipe(uint16_t size, const char name[])
 {
-    bool ok = (semaphore < MAX_SEMAPHORES);
+    _handle handle = allocObject(OBJECT_PIPE, name);
+    kernelObject* object = getObject(handle, OBJECT_PIPE);
+
+    if(object == NULL)
+        return INVALID_HANDLE;
+
+    object->obj.pip.buffer = mallocFromHeap(size);
+    if(size == 0 || object->obj.pip.buffer == NULL)
     {
-        semaphores[semaphore].count = count;
-        strcpy(semaphores[semaphore].name, name);
+        object->type = OBJECT_FREE;
+        return INVALID_HANDLE;
+    }
+
+    object->obj.pip.size = size;
+    object->obj.pip.head = 0;
+    object->obj.pip.count = 0;
+    object->obj.pip.readQueue.head = NO_TASK;
+    object->obj.pip.writeQueue.head = NO_TASK;
+    return handle;
+}
+
+_handle initBarrier(uint8_t count, const char name[])
+{
+    _handle handle = (count > 0) ? allocObject(OBJECT_BARRIER, name) : INVALID_HANDLE;
+    kernelObject* object = getObject(handle, OBJECT_BARRIER);
+
+    if(object != NULL)
+    {
+        object->obj.bar.count = count;
+        object->obj.bar.arrived = 0;
+        object->obj.bar.phase = 0;
+        object->obj.bar.queue.head = NO_TASK;
+    }
+    return handle;
+}
+
+// Unlinks a timer from its wheel slot
+void unlinkTimer(uint8_t i)
+{
+    timer* t = &objects[i].obj.tmr;
+
+    if(!t->active)
+        return;
+
+    if(t->prev == NO_OBJECT)
+        timerWheel[t->slot] = t->next;
+    else
+        objects[t->prev].obj.tmr.next = t->next;
+    if(t->next != NO_OBJECT)
+        objects[t->next].obj.tmr.prev = t->prev;
+    t->active = false;
+}
+
+// Links a timer into the slot of the tick it expires on, counting the passes over that slot to skip
+void armTimer(uint8_t i)
+{
+    timer* t = &objects[i].obj.tmr;
+
+    unlinkTimer(i);
+    t->slot = (timerTicks + t->interval) & (TIMER_WHEEL_SLOTS - 1);
+    t->rounds = (t->interval - 1) / TIMER_WHEEL_SLOTS;
+    t->prev = NO_OBJECT;
+    t->next = timerWheel[t->slot];
+    if(t->next != NO_OBJECT)
+        objects[t->next].obj.tmr.prev = i;
+    timerWheel[t->slot] = i;
+    t->active = true;
+}
+
+// Runs on each tick, moves the timers expiring now over to the daemon and re-arms the periodic ones
+void processTimers(void)
+{
+    uint8_t i;
+    uint8_t next;
+    timer* t;
+
+    timerTicks++;
+    for(i = timerWheel[timerTicks & (TIMER_WHEEL_SLOTS - 1)]; i != NO_OBJECT; i = next)
+    {
+        t = &objects[i].obj.tmr;
+        next = t->next;
+
+        if(t->rounds > 0)
+        {
+            t->rounds--;
+            continue;
+        }
+
+        if(t->periodic)
+            armTimer(i);
+        else
+            unlinkTimer(i);
+
+        // a timer is queued at most once (pending), so the queue never fills, the check just keeps it that way
+        if(t->pending || expiredCount >= MAX_KERNEL_OBJECTS)
+        {
+            t->overruns++;
+        }
+        else
+        {
+            t->pending = true;
+            expiredTimers[(expiredHead + expiredCount++) % MAX_KERNEL_OBJECTS] = i;
+        }
+    }
+
+    if(expiredCount > 0 && timerDaemonTask != NO_TASK)
+    {
+        tcb[timerDaemonTask].state = STATE_READY;
+        timerDaemonTask = NO_TASK;
+    }
+}
+
+// Takes a stopped or deleted timer's expiry back out of the daemon's queue, so it is never queued twice
+void unqueueTimer(uint8_t i)
+{
+    uint8_t n;
+    uint8_t kept = 0;
+    uint8_t queued;
+
+    if(!objects[i].obj.tmr.pending)
+        return;
+
+    objects[i].obj.tmr.pending = false;
+    for(n = 0; n < expiredCount; n++)
+    {
+        queued = expiredTimers[(expiredHead + n) % MAX_KERNEL_OBJECTS];
+        if(queued != i)
+            expiredTimers[(expiredHead + kept++) % MAX_KERNEL_OBJECTS] = queued;
+    }
+    expiredCount = kept;
+}
+
+_handle initTimer(_timerFn callback, uint32_t arg, const char name[])
+{
+    _handle handle = (callback != NULL) ? allocObject(OBJECT_TIMER, name) : INVALID_HANDLE;
+    kernelObject* object = getObject(handle, OBJECT_TIMER);
+
+    if(object != NULL)
+    {
+        object->obj.tmr.callback = callback;
+        object->obj.tmr.arg = arg;
+        object->obj.tmr.interval = 1;
+        object->obj.tmr.overruns = 0;
+        object->obj.tmr.periodic = false;
+        object->obj.tmr.active = false;
+        object->obj.tmr.pending = false;
+    }
+    return handle;
+}
+
+// Starts (or restarts) a timer to expire in ticks, then every ticks if periodic
+bool setTimer(_handle timer, uint32_t ticks, bool periodic)
+{
+    kernelObject* object = getObject(timer, OBJECT_TIMER);
+
+    if(object == NULL)
+        return false;
+
+    object->obj.tmr.interval = (ticks > 0) ? ticks : 1;
+    object->obj.tmr.periodic = periodic;
+    armTimer(HANDLE_INDEX(timer));
+    return true;
+}
+
+// Returns an object to the pool, fails if the object is in use
+bool destroyObject(_handle handle)
+{
+    uint8_t i = HANDLE_INDEX(handle);
+    uint8_t j;
+    uint8_t type;
+    kernelObject* object;
+    bool ok = (i < MAX_KERNEL_OBJECTS);
+
+    if(ok)
+    {
+        object = getObject(handle, objects[i].type);
+        ok = (object != NULL && object->type != OBJECT_FREE);
+    }
+
+    if(ok)
+    {
+        type = object->type;
+        switch(type)
+        {
+            case OBJECT_MUTEX:
+                // condition waiters reacquire it when woken (tcb[].relock)
+                ok = !object->obj.mtx.lock;
+                for(j = 0; j < MAX_TASKS; j++)
+                {
+                    if(tcb[j].state == STATE_BLOCKED_CONDITION && tcb[j].relock == i)
+                        ok = false;
+                }
+                break;
+            case OBJECT_SEMAPHORE:
+                ok = (object->obj.sem.queue.head == NO_TASK);
+                break;
+            case OBJECT_RWLOCK:
+                ok = !object->obj.rw.write && object->obj.rw.readers == 0;
+                break;
+            case OBJECT_CONDITION:
+                ok = (object->obj.cond.queue.head == NO_TASK);
+                break;
+            case OBJECT_EVENT:
+                ok = (object->obj.evt.queue.head == NO_TASK);
+                break;
+            case OBJECT_BARRIER:
+                ok = (object->obj.bar.queue.head == NO_TASK);
+                break;
+            case OBJECT_TIMER:
+                unlinkTimer(i);
+                unqueueTimer(i);
+                break;
+            case OBJECT_PIPE:
+                ok = (object->obj.pip.readQueue.head == NO_TASK && object->obj.pip.writeQueue.head == NO_TASK);
+                break;
+        }
+    }
+
+    if(ok)
+    {
+        object->type = OBJECT_FREE;
+
+        // Revoke a shared region from every task that could reach it before its memory goes back to the heap
+        if(type == OBJECT_SHARED)
+        {
+            for(j = 0; j < MAX_TASKS; j++)
+            {
+                if((object->obj.shm.readers | object->obj.shm.writers) & (1 << j))
+                    updateTaskAccess(j);
+            }
+            freeToHeap(object->obj.shm.base);
+        }
+        else if(type == OBJECT_PIPE)
+        {
+            freeToHeap(object->obj.pip.buffer);
+        }
     }
     return ok;
 }
 
+// Finds an object by name (for the shell and for tasks to look up shared objects)
+_handle findObject(const char name[])
+{
+    uint8_t i;
+
+    for(i = 0; i < MAX_KERNEL_OBJECTS; i++)
+    {
+        if(objects[i].type != OBJECT_FREE && strcmp(objects[i].name, name))
+            return MAKE_HANDLE(i);
+    }
+    return INVALID_HANDLE;
+}
+
+// Wakes the first task waiting on a condition and moves it over to the mutex it has to reacquire,
+// so it only becomes ready once it owns the mutex again
+bool signalWaiter(condition* cond)
+{
+    uint8_t task = dequeueTask(&cond->queue);
+    mutex* m;
+
+    if(task == NO_TASK)
+        return false;
+
+    m = &objects[tcb[task].relock].obj.mtx;
+    if(!m->lock)
+    {
+        m->lock = true;
+        m->depth = 1;
+        m->lockedBy = task;
+        tcb[task].state = STATE_READY;
+    }
+    else
+    {
+        tcb[task].blockedOn = tcb[task].relock;
+        enqueueTask(&m->queue, task);
+        tcb[task].state = STATE_BLOCKED_MUTEX;
+    }
+    return true;
+}
+
+// Hands a free rwlock to the next waiting writer, or to all waiting readers if no writer waits
+void grantRwLock(rwlock* rw)
+{
+    uint8_t task;
+
+    if(rw->write || rw->readers > 0)
+        return;
+
+    if(rw->writeQueue.head != NO_TASK)
+    {
+        rw->writer = dequeueTask(&rw->writeQueue);
+        rw->write = true;
+        tcb[rw->writer].state = STATE_READY;
+    }
+    else
+    {
+        while((task = dequeueTask(&rw->readQueue)) != NO_TASK)
+        {
+            rw->readers++;
+            rw->readerMask |= (1 << task);
+            tcb[task].state = STATE_READY;
+        }
+    }
+}
+
+// Drops any read or write access a task holds on a rwlock
+void releaseRwLock(rwlock* rw, uint8_t task)
+{
+    if(rw->write && rw->writer == task)
+    {
+        rw->write = false;
+    }
+    else if(rw->readerMask & (1 << task))
+    {
+        rw->readerMask &= ~(1 << task);
+        rw->readers--;
+    }
+    grantRwLock(rw);
+}
+
+// Removes a blocked task from the wait queue of the object blocking it
+void removeFromWaitQueue(uint8_t task)
+{
+    kernelObject* object = &objects[tcb[task].blockedOn];
+
+    // notifications and the timer daemon are not queued on an object
+    if(tcb[task].state == STATE_BLOCKED_NOTIFY)
+        return;
+    if(tcb[task].state == STATE_BLOCKED_TIMER)
+    {
+        timerDaemonTask = NO_TASK;
+        return;
+    }
+
+    switch(object->type)
+    {
+        case OBJECT_MUTEX:
+            removeTask(&object->obj.mtx.queue, task);
+            break;
+        case OBJECT_SEMAPHORE:
+            removeTask(&object->obj.sem.queue, task);
+            break;
+        case OBJECT_RWLOCK:
+            removeTask(&object->obj.rw.readQueue, task);
+            removeTask(&object->obj.rw.writeQueue, task);
+            grantRwLock(&object->obj.rw); // readers may have been held back by this writer
+            break;
+        case OBJECT_CONDITION:
+            removeTask(&object->obj.cond.queue, task);
+            break;
+        case OBJECT_EVENT:
+            removeTask(&object->obj.evt.queue, task);
+            break;
+        case OBJECT_PIPE:
+            removeTask(&object->obj.pip.readQueue, task);
+            removeTask(&object->obj.pip.writeQueue, task);
+            break;
+        case OBJECT_BARRIER:
+            removeTask(&object->obj.bar.queue, task);
+            object->obj.bar.arrived--;
+            break;
+    }
+}
+
+// Gives a semaphore to the first waiting task or adds to its count, returns the task woken or NO_TASK
+uint8_t giveSemaphore(semaphore* sem)
+{
+    uint8_t task = dequeueTask(&sem->queue);
+
+    if(task != NO_TASK)
+        tcb[task].state = STATE_READY;
+    else
+        sem->count++;
+    return task;
+}
+
+// Sets event flags and readies every task waiting on one of them (they take the flags when they run),
+// returns the highest priority task woken or NO_TASK
+uint8_t giveEvent(event* evt, uint32_t flags)
+{
+    uint8_t task = evt->queue.head;
+    uint8_t next;
+    uint8_t woken = NO_TASK;
+
+    evt->flags |= flags;
+    while(task != NO_TASK)
+    {
+        next = tcb[task].next;
+        if(tcb[task].eventMask & evt->flags)
+        {
+            removeTask(&evt->queue, task);
+            tcb[task].state = STATE_READY;
+            if(woken == NO_TASK || tcb[task].priority < tcb[woken].priority)
+                woken = task;
+        }
+        task = next;
+    }
+    return woken;
+}
+
+// Readies every task in a wait queue (they retry their call when they run),
+// returns the highest priority task woken or NO_TASK
+uint8_t wakeAll(waitQueue* queue)
+{
+    uint8_t task;
+    uint8_t woken = NO_TASK;
+
+    while((task = dequeueTask(queue)) != NO_TASK)
+    {
+        tcb[task].state = STATE_READY;
+        if(woken == NO_TASK || tcb[task].priority < tcb[woken].priority)
+            woken = task;
+    }
+    return woken;
+}
+
+// Copies up to n bytes into a pipe, returns the number copied
+uint32_t fillPipe(pipe* p, const uint8_t* data, uint32_t n)
+{
+    uint32_t copied = 0;
+    uint16_t tail = p->head + p->count;
+
+    if(tail >= p->size)
+        tail -= p->size;
+
+    while(copied < n && p->count < p->size)
+    {
+        p->buffer[tail] = data[copied++];
+        if(++tail == p->size)
+            tail = 0;
+        p->count++;
+    }
+    return copied;
+}
+
+// Copies up to n bytes out of a pipe, returns the number copied
+uint32_t drainPipe(pipe* p, uint8_t* data, uint32_t n)
+{
+    uint32_t copied = 0;
+
+    while(copied < n && p->count > 0)
+    {
+        data[copied++] = p->buffer[p->head];
+        if(++p->head == p->size)
+            p->head = 0;
+        p->count--;
+    }
+    return copied;
+}
+
+// Copies bytes out of a pipe up to and including the first newline, at most n, returns the number copied
+uint32_t drainPipeLine(pipe* p, uint8_t* data, uint32_t n)
+{
+    uint32_t copied = 0;
+
+    while(copied < n && p->count > 0)
+    {
+        data[copied++] = p->buffer[p->head];
+        if(++p->head == p->size)
+            p->head = 0;
+        p->count--;
+        if(data[copied - 1] == '\n')
+            break;
+    }
+    return copied;
+}
+
+// O(1) task handle lookup, returns NO_TASK if the handle is stale
+uint8_t getTask(_handle handle)
+{
+    uint8_t i = HANDLE_INDEX(handle);
+
+    if(i < MAX_TASKS && tcb[i].state != STATE_INVALID && tcb[i].generation == HANDLE_GENERATION(handle))
+        return i;
+    return NO_TASK;
+}
+
+// Updates a task's notification word and readies it if it is waiting, returns the task woken or NO_TASK
+uint8_t giveNotification(uint8_t task, uint32_t value, uint8_t action)
+{
+    if(action == NOTIFY_INCREMENT)
+        tcb[task].notification++;
+    else if(action == NOTIFY_OVERWRITE)
+        tcb[task].notification = value;
+    else
+        tcb[task].notification |= value;
+
+    if(tcb[task].state == STATE_BLOCKED_NOTIFY && tcb[task].notification != 0)
+    {
+        tcb[task].state = STATE_READY;
+        return task;
+    }
+    return NO_TASK;
+}
+
+// Called after an ISR (or an SVC releasing a group of tasks) readied a task,
+// pends a switch if that task should run before the current one
+void requestSwitchFromIsr(uint8_t task)
+{
+    if(task != NO_TASK && preemption && tcb[task].priority < tcb[taskCurrent].priority)
+        NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+}
+
+// ISR-safe post, usable from interrupts at KERNEL_INT_PRIORITY or below
+bool postFromIsr(_handle semaphore)
+{
+    uint32_t basePri = setBasePri(KERNEL_BASEPRI);
+    kernelObject* object = getObject(semaphore, OBJECT_SEMAPHORE);
+    uint8_t task = NO_TASK;
+
+    if(object != NULL)
+        task = giveSemaphore(&object->obj.sem);
+    setBasePri(basePri);
+
+    requestSwitchFromIsr(task);
+    return object != NULL;
+}
+
+// ISR-safe notify, usable from interrupts at KERNEL_INT_PRIORITY or below
+bool notifyFromIsr(_handle task, uint32_t value, uint8_t action)
+{
+    uint32_t basePri = setBasePri(KERNEL_BASEPRI);
+    uint8_t i = getTask(task);
+    uint8_t woken = NO_TASK;
+
+    if(i != NO_TASK)
+        woken = giveNotification(i, value, action);
+    setBasePri(basePri);
+
+    requestSwitchFromIsr(woken);
+    return i != NO_TASK;
+}
+
+// ISR-safe pipe write, never blocks, returns the number of bytes that fit
+uint32_t pipeWriteFromIsr(_handle pipe, const void* data, uint32_t n)
+{
+    uint32_t basePri = setBasePri(KERNEL_BASEPRI);
+    kernelObject* object = getObject(pipe, OBJECT_PIPE);
+    uint32_t copied = 0;
+    uint8_t task = NO_TASK;
+
+    if(object != NULL)
+    {
+        copied = fillPipe(&object->obj.pip, data, n);
+        if(copied > 0)
+            task = wakeAll(&object->obj.pip.readQueue);
+    }
+    setBasePri(basePri);
+
+    requestSwitchFromIsr(task);
+    return copied;
+}
+
+// ISR-safe pipe write of all n bytes or none (when there is not room for them), returns whether they were written
+bool pipeWriteAllFromIsr(_handle pipe, const void* data, uint32_t n)
+{
+    uint32_t basePri = setBasePri(KERNEL_BASEPRI);
+    kernelObject* object = getObject(pipe, OBJECT_PIPE);
+    bool written = false;
+    uint8_t task = NO_TASK;
+
+    if(object != NULL && (uint32_t)(object->obj.pip.size - object->obj.pip.count) >= n)
+    {
+        fillPipe(&object->obj.pip, data, n);
+        task = wakeAll(&object->obj.pip.readQueue);
+        written = true;
+    }
+    setBasePri(basePri);
+
+    requestSwitchFromIsr(task);
+    return written;
+}
+
+// ISR-safe pipe read, never blocks, returns the number of bytes taken
+uint32_t pipeReadFromIsr(_handle pipe, void* data, uint32_t n)
+{
+    uint32_t basePri = setBasePri(KERNEL_BASEPRI);
+    kernelObject* object = getObject(pipe, OBJECT_PIPE);
+    uint32_t copied = 0;
+    uint8_t task = NO_TASK;
+
+    if(object != NULL)
+    {
+        copied = drainPipe(&object->obj.pip, data, n);
+        if(copied > 0)
+            task = wakeAll(&object->obj.pip.writeQueue);
+    }
+    setBasePri(basePri);
+
+    requestSwitchFromIsr(task);
+    return copied;
+}
+
+// ISR-safe setEvent, usable from interrupts at KERNEL_INT_PRIORITY or below
+bool setEventFromIsr(_handle event, uint32_t flags)
+{
+    uint32_t basePri = setBasePri(KERNEL_BASEPRI);
+    kernelObject* object = getObject(event, OBJECT_EVENT);
+    uint8_t task = NO_TASK;
+
+    if(object != NULL)
+        task = giveEvent(&object->obj.evt, flags);
+    setBasePri(basePri);
+
+    requestSwitchFromIsr(task);
+    return object != NULL;
+}
+
+// Releases a mutex, handing it to the next task in its queue
+void releaseMutex(mutex* m)
+{
+    m->lock = false;
+    if(m->queue.head != NO_TASK)
+    {
+        m->lockedBy = dequeueTask(&m->queue);          // Lock mutex with next in queue
+        m->lock = true;
+        m->depth = 1;
+        tcb[m->lockedBy].state = STATE_READY;          // Next task in queue ready
+    }
+}
+
 // REQUIRED: initialize systick for 1ms system timer
 void initRtos(void)
 {
@@ -143,6 +1329,13 @@ void initRtos(void)
         tcb[i].state = STATE_INVALID;
         tcb[i].pid = 0;
     }
+    for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+        timerWheel[i] = NO_OBJECT;
+
+    // Kernel exceptions share one priority so they never preempt each other, context switch is lowest
+    NVIC_SYS_PRI2_R = (NVIC_SYS_PRI2_R & ~NVIC_SYS_PRI2_SVC_M) | (KERNEL_INT_PRIORITY << 29);
+    NVIC_SYS_PRI3_R = (NVIC_SYS_PRI3_R & ~(NVIC_SYS_PRI3_TICK_M | NVIC_SYS_PRI3_PENDSV_M))
+                      | (KERNEL_INT_PRIORITY << 29) | (PENDSV_INT_PRIORITY << 21);
 
     NVIC_ST_RELOAD_R = 39999; // Sets system to interrupt at 1kHz rate
     NVIC_ST_CTRL_R |= NVIC_ST_CTRL_INTEN | NVIC_ST_CTRL_ENABLE | NVIC_ST_CTRL_CLK_SRC; // Enable interrupts and systick
@@ -160,7 +1353,7 @@ uint8_t rtosScheduler(void)
         uint8_t i;
         uint8_t highest_priority = NUM_PRIORITIES;
         // Find highest priority with a task ready to run (lower prio wins)
-        for(i = 0; i < taskCount; i++)
+        for(i = 0; i < MAX_TASKS; i++)
         {
             if((tcb[i].state == STATE_READY || tcb[i].state == STATE_UNRUN) && tcb[i].priority < highest_priority)
                 highest_priority = tcb[i].priority;
@@ -199,19 +1392,101 @@ void startRtos(void)
     // Call scheduler and apply first tasks srd regions
     taskCurrent = rtosScheduler();
     applySramSrdMasks(tcb[taskCurrent].srd);
+    applyReadOnlyWindow(tcb[taskCurrent].window);
 
     // Set task as ready
     tcb[taskCurrent].state = STATE_READY;
 
-    // Set PSP address and set it as active SP (set ASP)
-    setPSPAddress((uint32_t) tcb[taskCurrent].sp);
-    setThreadStackToPSP();
+    // Set PSP address and set it as active SP (set ASP)
+    setPSPAddress((uint32_t) tcb[taskCurrent].sp);
+    setThreadStackToPSP();
+
+
+    // Call fn to set TMPL and launch first task
+    // (need to do this to store fn in R0 bc setting TMPL will deny access to globals)
+    // If this doesnt work go back to 10/19 lecture end of lecture like 1:15
+    launchTaskUnprivileged((uint32_t) tcb[taskCurrent].pid);
+}
+
+// Takes a heap block for a task's stack and private heap, with a guard subregion below it when
+// STACK_GUARD is set (guardBytes is left 0 without one)
+void* allocateStack(uint32_t size, uint32_t* guardBytes)
+{
+    *guardBytes = 0;
+    if(STACK_GUARD)
+        return mallocGuardedFromHeap(size, guardBytes);
+    return mallocFromHeap(size);
+}
+
+// Lays out a task's guard, stack and private heap in its heap block, then paints the stack and sets its srd masks.
+// The task gets the whole buddy block its stack came from, what is left over goes to its heap (or its stack without one)
+void placeThread(uint8_t task, void* block, uint32_t guardBytes, uint32_t stackBytes, uint32_t heapBytes)
+{
+    uint32_t blockBytes = generateTaskSrdMasks(tcb[task].srd, block, guardBytes);
+    uint8_t* stack = (uint8_t *) block + guardBytes;
+    uint32_t* word;
+
+    if(heapBytes == 0)
+        stackBytes = blockBytes - guardBytes;
+    else
+    {
+        heapBytes = blockBytes - guardBytes - stackBytes;
+        initTaskHeap((TASK_HEAP *)(stack + stackBytes), heapBytes);
+    }
+
+    tcb[task].sp = (void *)(stack + stackBytes);
+    tcb[task].spInit = (void *)(stack + stackBytes);
+    tcb[task].stackBytes = stackBytes;
+    tcb[task].heapBytes = heapBytes;
+    tcb[task].guardBytes = guardBytes;
+    tcb[task].stackPeak = 0;
+    for (word = (uint32_t *)stack; word < (uint32_t *)tcb[task].spInit; word++)
+        *word = STACK_PAINT;
+}
+
+// Moves the blocks of stopped and unrun tasks down into lower free blocks, so the blocks they leave behind
+// can merge with their buddies into larger ones. Neither kind of task has a frame that will be resumed
+// (restartThread starts a stopped task over at spInit), so a move only rebuilds the layout: sp, spInit,
+// the stack paint, the private heap and the srd masks. A task stopping itself may still be running on
+// its stack until the next switch, so it stays put. Returns the number of tasks moved
+uint8_t compactHeap(void)
+{
+    uint8_t i;
+    uint8_t moved = 0;
+    uint8_t srdMask[NUM_SRAM_REGIONS];
+    void* block;
+    void* old;
+    uint32_t guardBytes;
+    bool again = true;
 
+    // every move lowers a block, so this ends
+    while(again)
+    {
+        again = false;
+        for(i = 0; i < MAX_TASKS; i++)
+        {
+            if(tcb[i].state != STATE_UNRUN && (tcb[i].state != STATE_STOPPED || i == taskCurrent))
+                continue;
+
+            // the same request as the task's block, a lower block only helps when it is no larger
+            old = getStackBlock(i);
+            block = allocateStack(tcb[i].stackBytes + tcb[i].heapBytes, &guardBytes);
+            if(block == NULL)
+                continue;
+            if(block > old || generateHeapSrdMasks(srdMask, block) > generateHeapSrdMasks(srdMask, old))
+            {
+                freeToHeap(block);
+                continue;
+            }
 
-    // Call fn to set TMPL and launch first task
-    // (need to do this to store fn in R0 bc setting TMPL will deny access to globals)
-    // If this doesnt work go back to 10/19 lecture end of lecture like 1:15
-    launchTaskUnprivileged((uint32_t) tcb[taskCurrent].pid);
+            freeToHeap(old);
+            placeThread(i, block, guardBytes, tcb[i].stackBytes, tcb[i].heapBytes);
+            updateTaskAccess(i);
+            moved++;
+            again = true;
+        }
+    }
+    return moved;
 }
 
 // REQUIRED:
@@ -219,13 +1494,14 @@ void startRtos(void)
 // store the thread name
 // allocate stack space and store top of stack in sp and spInit
 // set the srd bits based on the memory allocation
-bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes)
+// a private heap of heapBytes (0 for none) shares the stack's block, above the top of the stack
+// when the heap has no block large enough, stopped tasks are packed down and the allocation tried again
+bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes, uint32_t heapBytes)
 {
     bool ok = false;
     uint8_t i = 0;
-    uint8_t j;
-    uint8_t srdMask[NUM_SRAM_REGIONS];
-    void* stackPtr;
+    void* block;
+    uint32_t guardBytes;
     bool found = false;
     if (taskCount < MAX_TASKS)
     {
@@ -240,16 +1516,29 @@ bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackByt
             i = 0;
             while (tcb[i].state != STATE_INVALID) {i++;}
 
-            stackPtr = mallocFromHeap(stackBytes);
-            generateSramSrdMasks(srdMask, stackPtr, stackBytes);
+            // with a private heap the stack ends inside the block, keep its top (and the heap header there)
+            // 8 byte aligned for AAPCS, and leave the heap room for its header and one block
+            if(heapBytes != 0)
+            {
+                stackBytes = (stackBytes + 7) & ~7;
+                if(heapBytes < TASK_HEAP_MIN_BYTES)
+                    heapBytes = TASK_HEAP_MIN_BYTES;
+            }
+
+            block = allocateStack(stackBytes + heapBytes, &guardBytes);
+            if(block == NULL && compactHeap() != 0)
+                block = allocateStack(stackBytes + heapBytes, &guardBytes);
+            if(block == NULL)
+                return false;
 
+            placeThread(i, block, guardBytes, stackBytes, heapBytes);
             tcb[i].state = STATE_UNRUN;
             tcb[i].pid = fn;
-            tcb[i].sp = (void *) ((uint8_t *) stackPtr + stackBytes);
-            tcb[i].spInit = (void *) ((uint8_t *) stackPtr + stackBytes);
+            tcb[i].notification = 0;
+            if(++tcb[i].generation == 0)
+                tcb[i].generation = 1;
+            tcb[i].window[1] = 0;
             tcb[i].priority = priority;
-            for (j = 0; j < NUM_SRAM_REGIONS; j++)
-                tcb[i].srd[j] = srdMask[j];
             strcpy(tcb[i].name, name);
 
             // increment task count
@@ -266,12 +1555,14 @@ void restartThread(_fn fn)
     uint8_t i;
 
     // Find the task and set the current sp to the top of the stack, and mark as unrun
-    for(i = 0; i < taskCount; i++)
+    for(i = 0; i < MAX_TASKS; i++)
     {
         if(tcb[i].pid == (void *)fn)
         {
             tcb[i].sp = tcb[i].spInit;
             tcb[i].state = STATE_UNRUN;
+            if(tcb[i].heapBytes != 0)
+                initTaskHeap((TASK_HEAP *)tcb[i].spInit, tcb[i].heapBytes);
             //break;
         }
     }
@@ -283,91 +1574,94 @@ void stopThread(_fn fn)
 {
     uint8_t i;
     uint8_t j;
-    uint8_t k;
 
     // Find the task, unlock any mutexes, remove from any resource queues, and mark as stopped
-    for(i = 0; i < taskCount; i++)
+    for(i = 0; i < MAX_TASKS; i++)
     {
         if(tcb[i].pid == fn)
         {
-            if(tcb[i].state == STATE_BLOCKED_MUTEX)
+            if(tcb[i].state >= STATE_BLOCKED_MUTEX)
             {
-                mutexes[tcb[i].mutex].lock = false;
-                if(mutexes[tcb[i].mutex].queueSize > 0)
-                {
-                    tcb[mutexes[tcb[i].mutex].processQueue[0]].state = STATE_READY; // Next task in queue ready
-                    mutexes[tcb[i].mutex].queueSize --;
-                    mutexes[tcb[i].mutex].lock = true;                              // Lock mutex with next in queue
-                    mutexes[tcb[i].mutex].lockedBy = mutexes[tcb[i].mutex].processQueue[0];
-
-                    // Dequeue
-                    for(j = 0; j < MAX_MUTEX_QUEUE_SIZE - 1; j++)
-                    {
-                        mutexes[tcb[i].mutex].processQueue[j] = mutexes[tcb[i].mutex].processQueue[j + 1];
-                    }
-                }
+                removeFromWaitQueue(i);
             }
-            else if(tcb[i].state == STATE_BLOCKED_SEMAPHORE)
+
+            for(j = 0; j < MAX_KERNEL_OBJECTS; j++)
             {
-                for(j = 0; j < semaphores[tcb[i].semaphore].queueSize; j++)
+                if(objects[j].type == OBJECT_MUTEX && objects[j].obj.mtx.lock && objects[j].obj.mtx.lockedBy == i)
                 {
-
-                   if(semaphores[tcb[i].semaphore].processQueue[j] == i)
-                   {
-                       // If others behind, shift queue
-                       if(j < semaphores[tcb[i].semaphore].queueSize - 1)
-                       {
-                           for(k = j; k < semaphores[tcb[i].semaphore].queueSize - 1; k++)
-                           {
-                               semaphores[tcb[i].semaphore].processQueue[k] = semaphores[tcb[i].semaphore].processQueue[k + 1];
-                           }
-                       }
-                       semaphores[tcb[i].semaphore].queueSize--;
-                   }
+                    releaseMutex(&objects[j].obj.mtx);
+                }
+                else if(objects[j].type == OBJECT_RWLOCK)
+                {
+                    releaseRwLock(&objects[j].obj.rw, i);
                 }
             }
 
-            for(j = 0; j < MAX_MUTEXES; j++)
+            tcb[i].state = STATE_STOPPED;
+           // break;
+        }
+    }
+}
+
+// Stops a thread, then returns its stack to the heap and frees its tcb for a later createThread
+bool deleteThread(_fn fn)
+{
+    uint8_t i;
+    uint8_t j;
+
+    for(i = 0; i < MAX_TASKS; i++)
+    {
+        if(tcb[i].state != STATE_INVALID && tcb[i].pid == fn)
+        {
+            stopThread(fn);
+
+            // Drop its shared memory grants, regions it created stay until deleted but lose their owner
+            for(j = 0; j < MAX_KERNEL_OBJECTS; j++)
             {
-                if(mutexes[j].lock && mutexes[j].lockedBy == i)
+                if(objects[j].type == OBJECT_SHARED)
                 {
-                    mutexes[j].lock = false;
-                    if(mutexes[j].queueSize > 0)
-                    {
-                        tcb[mutexes[j].processQueue[0]].state = STATE_READY; // Next task in queue ready
-                        mutexes[j].queueSize--;
-                        mutexes[j].lock = true;                              // Lock mutex with next in queue
-                        mutexes[j].lockedBy = mutexes[j].processQueue[0];
-
-                        // Dequeue
-                        for(k = 0; k < MAX_MUTEX_QUEUE_SIZE - 1; k++)
-                        {
-                            mutexes[j].processQueue[k] = mutexes[j].processQueue[k + 1];
-                        }
-                    }
+                    objects[j].obj.shm.readers &= ~(1 << i);
+                    objects[j].obj.shm.writers &= ~(1 << i);
+                    if(objects[j].obj.shm.owner == i)
+                        objects[j].obj.shm.owner = NO_TASK;
                 }
             }
 
-            tcb[i].state = STATE_STOPPED;
-           // break;
+            freeToHeap(getStackBlock(i));
+            tcb[i].state = STATE_INVALID;
+            tcb[i].pid = 0;
+            tcb[i].name[0] = '\0';
+            tcb[i].clocks[0] = 0;
+            tcb[i].clocks[1] = 0;
+            taskCount--;
+
+            // A thread deleting itself must not run again
+            if(i == taskCurrent)
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            return true;
         }
     }
+    return false;
 }
 
 // REQUIRED: modify this function to set a thread priority
-void setThreadPriority(_fn fn, uint8_t priority)
+// Returns the task's previous priority (priority itself when there is no such task)
+uint8_t setThreadPriority(_fn fn, uint8_t priority)
 {
+    uint8_t previous = priority;
     uint8_t i;
 
     // Find the task and set the current sp to the top of the stack, and mark as unrun
-    for(i = 0; i < taskCount; i++)
+    for(i = 0; i < MAX_TASKS; i++)
     {
         if(tcb[i].pid == fn)
         {
+            previous = tcb[i].priority;
             tcb[i].priority = priority;
             break;
         }
     }
+    return previous;
 }
 
 // REQUIRED: modify this function to yield execution back to scheduler using pendsv
@@ -383,26 +1677,55 @@ void sleep(uint32_t tick)
     __asm("     SVC  #1");
 }
 
-// REQUIRED: modify this function to lock a mutex using pendsv
-void lock(int8_t mutex)
+// Wakes one task waiting on the condition
+void signalCondition(_handle condition)
+{
+    __asm("     SVC  #26");
+}
+
+// Wakes all tasks waiting on the condition
+void broadcastCondition(_handle condition)
+{
+    __asm("     SVC  #27");
+}
+
+// Sets event flags, waking tasks waiting on them
+void setEvent(_handle event, uint32_t flags)
+{
+    __asm("     SVC  #30");
+}
+
+// Updates a task's notification word (see NOTIFY_ actions), waking it if it is waiting
+void notify(_handle task, uint32_t value, uint8_t action)
+{
+    __asm("     SVC  #32");
+}
+
+// Starts (or restarts) a software timer, its callback runs in the timer daemon
+void startTimer(_handle timer, uint32_t ticks, bool periodic)
+{
+    __asm("     SVC  #45");
+}
+
+void stopTimer(_handle timer)
 {
-    __asm("     SVC  #2");
+    __asm("     SVC  #46");
 }
 
-// REQUIRED: modify this function to unlock a mutex using pendsv
-void unlock(int8_t mutex)
+// Restarts a software timer with its last interval
+void resetTimer(_handle timer)
 {
-    __asm("     SVC  #3");
+    __asm("     SVC  #47");
 }
 
 // REQUIRED: modify this function to wait a semaphore using pendsv
-void wait(int8_t semaphore)
+void wait(_handle semaphore)
 {
     __asm("     SVC  #4");
 }
 
 // REQUIRED: modify this function to signal a semaphore is available using pendsv
-void post(int8_t semaphore)
+void post(_handle semaphore)
 {
     __asm("     SVC  #5");
 }
@@ -427,15 +1750,17 @@ void systickIsr(void)
         intCount = 0;
         clockCurrent ^= 1;
 
-        for(i = 0; i < taskCount; i++)
+        for(i = 0; i < MAX_TASKS; i++)
         {
             tcb[i].clocks[clockCurrent] = 0;
             clkSum += tcb[i].clocks[clockCurrent ^ 1];
         }
     }
 
+    processTimers();
+
     // For all sleeping tasks, decrement tick count
-    for(i = 0; i < taskCount; i++)
+    for(i = 0; i < MAX_TASKS; i++)
     {
         if(tcb[i].state == STATE_DELAYED && !(--tcb[i].ticks))
             tcb[i].state = STATE_READY;
@@ -450,14 +1775,16 @@ void systickIsr(void)
 // REQUIRED: process UNRUN and READY tasks differently
 void __attribute__((naked)) pendSvIsr(void)
 {
-    tcb[taskCurrent].clocks[clockCurrent] += startClocks - (NVIC_ST_CURRENT_R & NVIC_ST_CURRENT_M);
     uint32_t* psp;
 
-    // if DERR or IERR bit set, mpu fault, so must kill process
-    if(NVIC_FAULT_STAT_R & (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR))
+    // if DERR, IERR or MSTKE bit set, mpu fault, so must kill process
+    if(NVIC_FAULT_STAT_R & (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR | NVIC_FAULT_STAT_MSTKE))
     {
+        // PendSV runs below the kernel priority, so keep ISRs out while queues are edited
+        // (until the next task is dispatched)
+        setBasePri(KERNEL_BASEPRI);
         stopThread((_fn)tcb[taskCurrent].pid);
-        NVIC_FAULT_STAT_R |= (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR);
+        NVIC_FAULT_STAT_R |= (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR | NVIC_FAULT_STAT_MSTKE);
     }
 
     // else save program state
@@ -500,17 +1827,31 @@ void __attribute__((naked)) pendSvIsr(void)
         __asm("                     STR   R4, [R0, #-4]!");   // push R4 to psp
         __asm("                     MSR   PSP, R0");          // Store new PSP address
 
+        // LR is saved, so calls are safe from here on
+        setBasePri(KERNEL_BASEPRI);
+
         psp = getPSP(); // Get new psp address after pushes
         tcb[taskCurrent].sp = (void *)psp; // Save PSP to tcb
+
+        // these pushes are privileged, so they can land in the guard without faulting
+        if((uint8_t *)psp < (uint8_t *)tcb[taskCurrent].spInit - tcb[taskCurrent].stackBytes)
+            stopOverflowedThread();
     }
 
 
+    // SysTick charges startClocks to taskCurrent, so both change while it is held off: the outgoing task
+    // is charged up to here and the next task from here on
+    tcb[taskCurrent].clocks[clockCurrent] += startClocks - (NVIC_ST_CURRENT_R & NVIC_ST_CURRENT_M);
+
     // Schedule next task and apply its srd regions
     taskCurrent = rtosScheduler();
+    startClocks = NVIC_ST_CURRENT_R & NVIC_ST_CURRENT_M; //Current value of systick counter
     applySramSrdMasks(tcb[taskCurrent].srd);
+    applyReadOnlyWindow(tcb[taskCurrent].window);
 
     // PendSV pending cleared
     NVIC_INT_CTRL_R |= NVIC_INT_CTRL_UNPEND_SV;
+    setBasePri(0);
 
     psp = (uint32_t *)tcb[taskCurrent].sp;
     setPSPAddress((uint32_t)psp);       // Restore PSP address
@@ -569,8 +1910,6 @@ void __attribute__((naked)) pendSvIsr(void)
         __asm("     MOV   LR, R0");              // Move non-fp excl res into LR
     }
 
-    startClocks = NVIC_ST_CURRENT_R & NVIC_ST_CURRENT_M; //Current value of systick counter
-
     __asm("     BX LR"); //BX LR (Returns to program, and pushes correct registers based on EXCL_RES)
 }
 
@@ -588,15 +1927,14 @@ void svCallIsr(void)
     // Extract all possible parameters
     uint32_t r0 = *psp;
     uint32_t r1 = *(psp + 1);
-    uint8_t srdMask[NUM_SRAM_REGIONS];
     bool ok;
 
-    MUTEX_INFO* mutexInfo;
-    SEMAPHORE_INFO* semaphoreInfo;
+    OBJECT_INFO* objectInfo;
     TASK_INFO* taskInfo;
+    kernelObject* object;
+    kernelObject* m;
     uint32_t pid = 0;
-    char* str = {0};
-    char buf[BUF_SIZE] = {0};
+    char name[NAME_BYTES];
 
     uint8_t i;
 
@@ -612,139 +1950,331 @@ void svCallIsr(void)
             NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV; // Pend PendSv
             break;
         case LOCK:
-            // If mutex is unlocked then lock. Else add to queue
-            if(!mutexes[r0].lock) //R0 contains index of mutex
+            object = getObject(r0, OBJECT_MUTEX);     // R0 contains handle of mutex
+            *psp = (object != NULL);                  // Returns false for a bad handle or a relock that would deadlock
+            if(object == NULL)
+                return;
+
+            // If mutex is unlocked then lock. If the owner locks again, nest (recursive) or refuse. Else add to queue
+            if(!object->obj.mtx.lock)
+            {
+                object->obj.mtx.lock = true;
+                object->obj.mtx.depth = 1;
+                object->obj.mtx.lockedBy = taskCurrent;
+                return;
+            }
+            else if(object->obj.mtx.lockedBy == taskCurrent)
             {
-                mutexes[r0].lock = true;
-                mutexes[r0].lockedBy = taskCurrent;
+                if(object->obj.mtx.recursive && object->obj.mtx.depth < 0xFF)
+                    object->obj.mtx.depth++;
+                else
+                    *psp = 0;
                 return;
             }
             else
             {
-                tcb[taskCurrent].mutex = r0;                                   // Add blocked mutex to tcb entry
-                mutexes[r0].processQueue[mutexes[r0].queueSize] = taskCurrent; // Add to queue
-                mutexes[r0].queueSize++;                                       // Incr. queue size
-                tcb[taskCurrent].state = STATE_BLOCKED_MUTEX;                  // Set state
-                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;                      // Pend PendSv
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);         // Add blocked mutex to tcb entry
+                enqueueTask(&object->obj.mtx.queue, taskCurrent);      // Add to queue
+                tcb[taskCurrent].state = STATE_BLOCKED_MUTEX;          // Set state
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;              // Pend PendSv
             }
             break;
         case UNLOCK:
-            // If mutex was locked by task, unlock, and allow next task in queue to run
-            if(mutexes[r0].lockedBy == taskCurrent)
-            {
-                mutexes[r0].lock = false;
-                if(mutexes[r0].queueSize > 0)
-                {
-                    tcb[mutexes[r0].processQueue[0]].state = STATE_READY; // Next task in queue ready
-                    mutexes[r0].queueSize--;
-                    mutexes[r0].lock = true;                              // Lock mutex with next in queue
-                    mutexes[r0].lockedBy = mutexes[r0].processQueue[0];
+            object = getObject(r0, OBJECT_MUTEX);
 
-                    // Dequeue
-                    for(i = 0; i < MAX_MUTEX_QUEUE_SIZE - 1; i++)
-                    {
-                        mutexes[r0].processQueue[i] = mutexes[r0].processQueue[i + 1];
-                    }
-                }
+            // If mutex was locked by task, unlock once it has unlocked as often as it locked,
+            // and allow next task in queue to run. Returns false if the caller is not the owner
+            *psp = (object != NULL && object->obj.mtx.lock && object->obj.mtx.lockedBy == taskCurrent);
+            if(*psp && --object->obj.mtx.depth == 0)
+            {
+                releaseMutex(&object->obj.mtx);
             }
             break;
         case WAIT:
+            object = getObject(r0, OBJECT_SEMAPHORE);
+            if(object == NULL)
+                return;
+
             // If semaphore count > 0, decrement count and return. Else place in queue and wait
-            if(semaphores[r0].count > 0)
+            if(object->obj.sem.count > 0)
             {
-                semaphores[r0].count--;
+                object->obj.sem.count--;
                 return;
             }
             else
             {
-                semaphores[r0].processQueue[semaphores[r0].queueSize] = taskCurrent;
-                semaphores[r0].queueSize++;
-                tcb[taskCurrent].semaphore = r0;                  // Log in tcb what semaphore is blocking task
+                enqueueTask(&object->obj.sem.queue, taskCurrent);
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);    // Log in tcb what semaphore is blocking task
                 tcb[taskCurrent].state = STATE_BLOCKED_SEMAPHORE; // Update task state
                 NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;         // Pend PendSv
             }
             break;
         case POST:
-            semaphores[r0].count++;
-            //If someone in queue set task to ready and update queue
-            if(semaphores[r0].queueSize > 0)
+            object = getObject(r0, OBJECT_SEMAPHORE);
+            if(object == NULL)
+                return;
+
+            // If someone in queue hand the count straight to them, else increment count
+            giveSemaphore(&object->obj.sem);
+            break;
+        case READ_LOCK:
+            object = getObject(r0, OBJECT_RWLOCK);
+            *psp = (object != NULL);                  // Returns false for a bad handle or a relock that would deadlock
+            if(object == NULL)
+                return;
+
+            // A task that already holds the lock can't take it again: a nested read would be released by
+            // the first unlock, and a read under its own write lock would wait on itself
+            if((object->obj.rw.readerMask & (1 << taskCurrent)) || (object->obj.rw.write && object->obj.rw.writer == taskCurrent))
             {
-                tcb[semaphores[r0].processQueue[0]].state = STATE_READY;
-                semaphores[r0].queueSize--;
+                *psp = 0;
+                return;
+            }
 
-                // Dequeue
-                for(i = 0; i < MAX_SEMAPHORE_QUEUE_SIZE - 1; i++)
-                {
-                    semaphores[r0].processQueue[i] = semaphores[r0].processQueue[i + 1];
-                }
-                semaphores[r0].count--; // Decrement count since process in queue
+            // Readers only get in if no writer holds or is waiting for the lock
+            if(!object->obj.rw.write && object->obj.rw.writeQueue.head == NO_TASK)
+            {
+                object->obj.rw.readers++;
+                object->obj.rw.readerMask |= (1 << taskCurrent);
+                return;
+            }
+            else
+            {
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);
+                enqueueTask(&object->obj.rw.readQueue, taskCurrent);
+                tcb[taskCurrent].state = STATE_BLOCKED_MUTEX;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
             }
             break;
-        case PIDOF:
-            str = (char *) r0;
+        case READ_UNLOCK:
+            object = getObject(r0, OBJECT_RWLOCK);
+            *psp = (object != NULL && (object->obj.rw.readerMask & (1 << taskCurrent)));
+            if(*psp)
+                releaseRwLock(&object->obj.rw, taskCurrent);
+            break;
+        case WRITE_LOCK:
+            object = getObject(r0, OBJECT_RWLOCK);
+            *psp = (object != NULL);                  // Returns false for a bad handle or a relock that would deadlock
+            if(object == NULL)
+                return;
 
-            if(str != NULL)
+            // A reader can't upgrade (it would wait for itself to leave) and the writer can't lock again
+            if((object->obj.rw.readerMask & (1 << taskCurrent)) || (object->obj.rw.write && object->obj.rw.writer == taskCurrent))
             {
-                for(i = 0; i < taskCount; i++)
-                {
-                    if(strcmp(tcb[i].name, str))
-                    {
-                        pid = (uint32_t)tcb[i].pid;
-                    }
-                }
+                *psp = 0;
+                return;
             }
 
-            *psp = pid;
+            if(!object->obj.rw.write && object->obj.rw.readers == 0)
+            {
+                object->obj.rw.write = true;
+                object->obj.rw.writer = taskCurrent;
+                return;
+            }
+            else
+            {
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);
+                enqueueTask(&object->obj.rw.writeQueue, taskCurrent);
+                tcb[taskCurrent].state = STATE_BLOCKED_MUTEX;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            }
+            break;
+        case WRITE_UNLOCK:
+            object = getObject(r0, OBJECT_RWLOCK);
+            *psp = (object != NULL && object->obj.rw.write && object->obj.rw.writer == taskCurrent);
+            if(*psp)
+                releaseRwLock(&object->obj.rw, taskCurrent);
             break;
-        case MUT:
-            mutexInfo = (MUTEX_INFO *) r0;
+        case COND_WAIT:
+            object = getObject(r0, OBJECT_CONDITION);
+            m = getObject(r1, OBJECT_MUTEX);
+
+            // Caller must own the mutex it waits with, and hold it only once since a single unlock releases it,
+            // else it gets false back without waiting
+            *psp = !(object == NULL || m == NULL || !m->obj.mtx.lock || m->obj.mtx.lockedBy != taskCurrent || m->obj.mtx.depth != 1);
+            if(!*psp)
+                return;
 
-            generateSramSrdMasks(srdMask, (void *)mutexInfo, sizeof(*mutexInfo));
-            ok = verifyAccess(srdMask, tcb[taskCurrent].srd);
+            tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);
+            tcb[taskCurrent].relock = HANDLE_INDEX(r1);
+            enqueueTask(&object->obj.cond.queue, taskCurrent);
+            tcb[taskCurrent].state = STATE_BLOCKED_CONDITION;
+            releaseMutex(&m->obj.mtx);
+            NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            break;
+        case COND_SIGNAL:
+            object = getObject(r0, OBJECT_CONDITION);
+            if(object != NULL)
+                signalWaiter(&object->obj.cond);
+            break;
+        case COND_BCAST:
+            object = getObject(r0, OBJECT_CONDITION);
+            if(object != NULL)
+                while(signalWaiter(&object->obj.cond));
+            break;
+        case EVENT_WAIT:
+            object = getObject(r0, OBJECT_EVENT);
+            *(psp + 1) = 0;
+            if(object == NULL)
+            {
+                *psp = 0;
+                return;
+            }
 
-            if(r1 > MAX_MUTEXES - 1)
-                ok = false;
+            // Take and clear any requested flags that are set, else block and have the wrapper retry once woken
+            if(r1 == 0)
+                r1 = 0xFFFFFFFF;
+            *psp = object->obj.evt.flags & r1;
+            object->obj.evt.flags &= ~r1;
+            if(*psp == 0)
+            {
+                *(psp + 1) = 1;
+                tcb[taskCurrent].eventMask = r1;
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);
+                enqueueTask(&object->obj.evt.queue, taskCurrent);
+                tcb[taskCurrent].state = STATE_BLOCKED_EVENT;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            }
+            break;
+        case EVENT_SET:
+            object = getObject(r0, OBJECT_EVENT);
+            if(object != NULL)
+                giveEvent(&object->obj.evt, r1);
+            break;
+        case NOTIFY:
+            i = getTask(r0);
+            if(i != NO_TASK)
+                giveNotification(i, r1, *(psp + 2));
+            break;
+        case NOTIFY_TAKE:
+            // Return the notification word if set (clearing it or taking one count),
+            // else block and have the wrapper retry once woken
+            *psp = tcb[taskCurrent].notification;
+            *(psp + 1) = 0;
+            if(*psp != 0)
+            {
+                if(r0)
+                    tcb[taskCurrent].notification = 0;
+                else
+                    tcb[taskCurrent].notification--;
+            }
+            else
+            {
+                *(psp + 1) = 1;
+                tcb[taskCurrent].state = STATE_BLOCKED_NOTIFY;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            }
+            break;
+        case TASK_HANDLE:
+            *psp = INVALID_HANDLE;
 
-            if(ok)
+            if(copyTaskName(name, (char *)r0))
             {
-                mutexInfo->lock = mutexes[r1].lock;
-                strcpy(mutexInfo->lockedBy, tcb[mutexes[r1].lockedBy].name);
-                strcpy(mutexInfo->name, mutexes[r1].name);
-                mutexInfo->numWaiters = mutexes[r1].queueSize;
-                if(mutexes[r1].queueSize > 0)
+                for(i = 0; i < MAX_TASKS; i++)
                 {
-                    for(i = 0; i < mutexes[r1].queueSize; i++)
-                    {
-                        strcpy(mutexInfo->waiters[i], tcb[mutexes[r1].processQueue[i]].name);
-                    }
+                    if(tcb[i].state != STATE_INVALID && strcmp(tcb[i].name, name))
+                        *psp = MAKE_TASK_HANDLE(i);
                 }
-                *psp = 1;
             }
-            else
+            break;
+        case PIDOF:
+            if(copyTaskName(name, (char *)r0))
             {
-                *psp = 0;
+                for(i = 0; i < MAX_TASKS; i++)
+                {
+                    if(tcb[i].state != STATE_INVALID && strcmp(tcb[i].name, name))
+                    {
+                        pid = (uint32_t)tcb[i].pid;
+                    }
+                }
             }
 
+            *psp = pid;
             break;
-        case SEM:
-            semaphoreInfo = (SEMAPHORE_INFO *) r0;
+        case OBJ_INFO:
+            objectInfo = (OBJECT_INFO *) r0;
 
-            generateSramSrdMasks(srdMask, (void *)semaphoreInfo, sizeof(*semaphoreInfo));
-            ok = verifyAccess(srdMask, tcb[taskCurrent].srd);
+            ok = verifyTaskBuffer((void *)objectInfo, sizeof(*objectInfo));
 
-            if(r1 > MAX_SEMAPHORES - 1)
+            if(r1 > MAX_KERNEL_OBJECTS - 1)
                 ok = false;
 
             if(ok)
             {
-                semaphoreInfo->count = semaphores[r1].count;
-                strcpy(semaphoreInfo->name, semaphores[r1].name);
-                semaphoreInfo->numWaiters = semaphores[r1].queueSize;
-                if(semaphores[r1].queueSize > 0)
+                object = &objects[r1];
+                objectInfo->type = object->type;
+                objectInfo->handle = MAKE_HANDLE(r1);
+                strcpy(objectInfo->name, object->name);
+
+                if(object->type == OBJECT_MUTEX)
+                {
+                    objectInfo->info.mutex.lock = object->obj.mtx.lock;
+                    objectInfo->info.mutex.recursive = object->obj.mtx.recursive;
+                    objectInfo->info.mutex.depth = object->obj.mtx.depth;
+                    strcpy(objectInfo->info.mutex.lockedBy, tcb[object->obj.mtx.lockedBy].name);
+                    objectInfo->info.mutex.numWaiters = getWaiterNames(&object->obj.mtx.queue, objectInfo->info.mutex.waiters);
+                }
+                else if(object->type == OBJECT_SEMAPHORE)
                 {
-                    for(i = 0; i < semaphores[r1].queueSize; i++)
+                    objectInfo->info.semaphore.count = object->obj.sem.count;
+                    objectInfo->info.semaphore.numWaiters = getWaiterNames(&object->obj.sem.queue, objectInfo->info.semaphore.waiters);
+                }
+                else if(object->type == OBJECT_RWLOCK)
+                {
+                    objectInfo->info.rwlock.readers = object->obj.rw.readers;
+                    objectInfo->info.rwlock.write = object->obj.rw.write;
+                    strcpy(objectInfo->info.rwlock.writer, tcb[object->obj.rw.writer].name);
+                    objectInfo->info.rwlock.numWaitingWriters = getWaiterNames(&object->obj.rw.writeQueue, objectInfo->info.rwlock.waitingWriters);
+                    objectInfo->info.rwlock.numWaitingReaders = 0;
+                    for(i = object->obj.rw.readQueue.head; i != NO_TASK; i = tcb[i].next)
+                        objectInfo->info.rwlock.numWaitingReaders++;
+                }
+                else if(object->type == OBJECT_CONDITION)
+                {
+                    objectInfo->info.condition.numWaiters = getWaiterNames(&object->obj.cond.queue, objectInfo->info.condition.waiters);
+                }
+                else if(object->type == OBJECT_EVENT)
+                {
+                    objectInfo->info.event.flags = object->obj.evt.flags;
+                    objectInfo->info.event.numWaiters = getWaiterNames(&object->obj.evt.queue, objectInfo->info.event.waiters);
+                }
+                else if(object->type == OBJECT_TIMER)
+                {
+                    objectInfo->info.timer.active = object->obj.tmr.active;
+                    objectInfo->info.timer.periodic = object->obj.tmr.periodic;
+                    objectInfo->info.timer.interval = object->obj.tmr.interval;
+                    objectInfo->info.timer.overruns = object->obj.tmr.overruns;
+                    objectInfo->info.timer.remaining = object->obj.tmr.rounds * TIMER_WHEEL_SLOTS
+                                                       + ((object->obj.tmr.slot - timerTicks) & (TIMER_WHEEL_SLOTS - 1));
+                }
+                else if(object->type == OBJECT_BARRIER)
+                {
+                    objectInfo->info.barrier.count = object->obj.bar.count;
+                    objectInfo->info.barrier.arrived = object->obj.bar.arrived;
+                    objectInfo->info.barrier.phase = object->obj.bar.phase;
+                    objectInfo->info.barrier.numWaiters = getWaiterNames(&object->obj.bar.queue, objectInfo->info.barrier.waiters);
+                }
+                else if(object->type == OBJECT_PIPE)
+                {
+                    objectInfo->info.pipe.size = object->obj.pip.size;
+                    objectInfo->info.pipe.count = object->obj.pip.count;
+                    objectInfo->info.pipe.numReaders = getWaiterNames(&object->obj.pip.readQueue, objectInfo->info.pipe.readers);
+                    objectInfo->info.pipe.numWriters = getWaiterNames(&object->obj.pip.writeQueue, objectInfo->info.pipe.writers);
+                }
+                else if(object->type == OBJECT_SHARED)
+                {
+                    objectInfo->info.shared.base = (uint32_t)object->obj.shm.base;
+                    objectInfo->info.shared.size = object->obj.shm.size;
+                    strcpy(objectInfo->info.shared.owner, (object->obj.shm.owner != NO_TASK) ? tcb[object->obj.shm.owner].name : "-");
+                    objectInfo->info.shared.numTasks = 0;
+                    for(i = 0; i < MAX_TASKS; i++)
                     {
-                        strcpy(semaphoreInfo->waiters[i], tcb[semaphores[r1].processQueue[i]].name);
+                        if((object->obj.shm.readers | object->obj.shm.writers) & (1 << i))
+                        {
+                            strcpy(objectInfo->info.shared.tasks[objectInfo->info.shared.numTasks], tcb[i].name);
+                            objectInfo->info.shared.access[objectInfo->info.shared.numTasks++] =
+                                (object->obj.shm.writers & (1 << i)) ? SHARED_READ_WRITE : SHARED_READ;
+                        }
                     }
                 }
                 *psp = 1;
@@ -754,10 +2284,12 @@ void svCallIsr(void)
                 *psp = 0;
             }
             break;
+        case HANDLE:
+            *psp = copyTaskName(name, (char *)r0) ? findObject(name) : INVALID_HANDLE;
+            break;
         case PS:
             taskInfo = (TASK_INFO *) r0;
-            generateSramSrdMasks(srdMask, (void *)taskInfo, sizeof(*taskInfo));
-            ok = verifyAccess(srdMask, tcb[taskCurrent].srd);
+            ok = verifyTaskBuffer((void *)taskInfo, sizeof(*taskInfo));
 
             if(r1 > MAX_TASKS)
                 ok = false;
@@ -767,8 +2299,12 @@ void svCallIsr(void)
                 strcpy(taskInfo->name, "Kernel\0");
                 taskInfo->pid = 0;
                 taskInfo->state = STATE_READY;
+                taskInfo->heapBytes = 0;
+                taskInfo->heapUsed = 0;
+                taskInfo->stackBytes = 0;
+                taskInfo->stackUsed = 0;
 
-                strcpy(taskInfo->cpuUsage, iftoa((PERIOD_CLKS - clkSum) * 2500, 9, 2, buf));
+                taskInfo->cpuUsage = (PERIOD_CLKS - clkSum) / CPU_USAGE_CLKS;
                 *psp = 1;
 
             }
@@ -778,15 +2314,12 @@ void svCallIsr(void)
                 taskInfo->pid = (uint32_t)tcb[r1].pid;
                 taskInfo->state = tcb[r1].state;
                 taskInfo->ticks = tcb[r1].ticks;
+                taskInfo->heapBytes = tcb[r1].heapBytes;
+                taskInfo->heapUsed = (tcb[r1].heapBytes != 0) ? ((TASK_HEAP *)tcb[r1].spInit)->used : 0;
+                taskInfo->stackBytes = tcb[r1].stackBytes;
+                taskInfo->stackUsed = (tcb[r1].state != STATE_INVALID) ? getStackPeak(r1) : 0;
 
-                if(tcb[r1].clocks[clockCurrent ^ 1] > 0)
-                {
-                    // avoids fp math since period is 1000000 clks
-                    // shift decimal 8 times to account for div by 1000000 and 2 extra from prescaling by 10000
-                    strcpy(taskInfo->cpuUsage, iftoa((uint64_t)tcb[r1].clocks[clockCurrent ^ 1] * 2500, 9, 2, buf));
-                }
-                else
-                    strcpy(taskInfo->cpuUsage, "00.00\0");
+                taskInfo->cpuUsage = tcb[r1].clocks[clockCurrent ^ 1] / CPU_USAGE_CLKS;
 
 
                 *psp = 1;
@@ -803,6 +2336,55 @@ void svCallIsr(void)
         case KILL:
             stopThread((_fn)r0);
             break;
+        case SPAWN:
+            *psp = copyTaskName(name, (char *)r1) && createThread((_fn)r0, name, *(psp + 2), *(psp + 3), 0);
+            break;
+        case DELETE:
+            *psp = deleteThread((_fn)r0);
+            break;
+        case HEAP_FREE:
+            *psp = getFreeHeap();
+            break;
+        case TASK_HEAP_PTR:
+            *psp = (tcb[taskCurrent].heapBytes != 0) ? (uint32_t)tcb[taskCurrent].spInit : 0;
+            break;
+        case HEAP_STATS:
+            if(verifyTaskBuffer((void *)r0, sizeof(HEAP_INFO)))
+            {
+                getHeapStats((HEAP_INFO *)r0);
+                *psp = true;
+            }
+            else
+                *psp = false;
+            break;
+        case HEAP_MAP:
+            // one block per call, so the heap is only held for a short walk
+            if(verifyTaskBuffer((void *)r0, sizeof(HEAP_BLOCK)) && getHeapBlock(r1, (HEAP_BLOCK *)r0))
+            {
+                if(((HEAP_BLOCK *)r0)->free)
+                    strcpy(((HEAP_BLOCK *)r0)->owner, "-");
+                else
+                    getHeapOwner(((HEAP_BLOCK *)r0)->base, ((HEAP_BLOCK *)r0)->owner);
+                *psp = true;
+            }
+            else
+                *psp = false;
+            break;
+        case COMPACT:
+            *psp = compactHeap();
+            break;
+        case HEAP_BENCH:
+            // each call runs one chunk with SysTick and PendSV held off, so only the heap calls are timed,
+            // and asks the wrapper (via r1) to call again until the run is done
+            *(psp + 1) = 0;
+            if(verifyTaskBuffer((void *)r0, sizeof(HEAP_LATENCY)))
+            {
+                *(psp + 1) = !measureHeapLatency((HEAP_LATENCY *)r0, *(psp + 2) != 0);
+                *psp = true;
+            }
+            else
+                *psp = false;
+            break;
         case PREEMPT_EN:
             preemption = true;
             break;
@@ -810,13 +2392,210 @@ void svCallIsr(void)
             preemption = false;
             break;
         case SCHED_PRIO:
+            *psp = priorityScheduler;                 // Returns the previous mode so callers can put it back
             priorityScheduler = true;
             break;
         case SCHED_RR:
+            *psp = priorityScheduler;
             priorityScheduler = false;
             break;
         case SET_PRIO:
-            setThreadPriority((_fn)r0, r1);
+            *psp = setThreadPriority((_fn)r0, r1);
+            break;
+        case CREATE_MUT:
+            *psp = copyTaskName(name, (char *)r0) ? initMutex(name) : INVALID_HANDLE;
+            break;
+        case BARRIER_WAIT:
+            object = getObject(r0, OBJECT_BARRIER);
+            *psp = 0;
+            if(object == NULL)
+                return;
+
+            // The last task to arrive releases the others in one go, starts the next phase and returns true
+            if(++object->obj.bar.arrived == object->obj.bar.count)
+            {
+                object->obj.bar.arrived = 0;
+                object->obj.bar.phase++;
+                requestSwitchFromIsr(wakeAll(&object->obj.bar.queue));
+                *psp = 1;
+            }
+            else
+            {
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);
+                enqueueTask(&object->obj.bar.queue, taskCurrent);
+                tcb[taskCurrent].state = STATE_BLOCKED_BARRIER;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            }
+            break;
+        case CREATE_TMR:
+            *psp = copyTaskName(name, (char *)*(psp + 2)) ? initTimer((_timerFn)r0, r1, name) : INVALID_HANDLE;
+            break;
+        case TIMER_START:
+            setTimer(r0, r1, *(psp + 2));
+            break;
+        case TIMER_STOP:
+            object = getObject(r0, OBJECT_TIMER);
+            if(object != NULL)
+            {
+                unlinkTimer(HANDLE_INDEX(r0));
+                unqueueTimer(HANDLE_INDEX(r0)); // drop an expiry the daemon has not run yet
+            }
+            break;
+        case TIMER_RESET:
+            object = getObject(r0, OBJECT_TIMER);
+            if(object != NULL)
+                armTimer(HANDLE_INDEX(r0));
+            break;
+        case TIMER_TAKE:
+            // Hand the daemon the next expired timer's callback, else block and have the wrapper retry once woken
+            *(psp + 1) = 0;
+            if(!verifyTaskBuffer((void *)r0, sizeof(TIMER_EXPIRY)))
+                return;
+
+            // Stopped and deleted timers are taken out of the queue, so every entry is a pending timer
+            if(expiredCount > 0)
+            {
+                object = &objects[expiredTimers[expiredHead]];
+                expiredHead = (expiredHead + 1) % MAX_KERNEL_OBJECTS;
+                expiredCount--;
+
+                object->obj.tmr.pending = false;
+                ((TIMER_EXPIRY *)r0)->callback = object->obj.tmr.callback;
+                ((TIMER_EXPIRY *)r0)->arg = object->obj.tmr.arg;
+                return;
+            }
+
+            *(psp + 1) = 1;
+            timerDaemonTask = taskCurrent;
+            tcb[taskCurrent].state = STATE_BLOCKED_TIMER;
+            NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            break;
+        case CREATE_BAR:
+            *psp = copyTaskName(name, (char *)r1) ? initBarrier(r0, name) : INVALID_HANDLE;
+            break;
+        case CREATE_RMUT:
+            *psp = copyTaskName(name, (char *)r0) ? initRecursiveMutex(name) : INVALID_HANDLE;
+            break;
+        case CREATE_SEM:
+            *psp = copyTaskName(name, (char *)r1) ? initSemaphore(r0, name) : INVALID_HANDLE;
+            break;
+        case DELETE_OBJ:
+            *psp = destroyObject(r0);
+            applyTaskAccess();
+            break;
+        case CREATE_RW:
+            *psp = copyTaskName(name, (char *)r0) ? initRwLock(name) : INVALID_HANDLE;
+            break;
+        case CREATE_COND:
+            *psp = copyTaskName(name, (char *)r0) ? initCondition(name) : INVALID_HANDLE;
+            break;
+        case CREATE_EVT:
+            *psp = copyTaskName(name, (char *)r0) ? initEvent(name) : INVALID_HANDLE;
+            break;
+        case CREATE_SHM:
+            *psp = copyTaskName(name, (char *)r1) ? initShared(r0, taskCurrent, name) : INVALID_HANDLE;
+            applyTaskAccess();
+            break;
+        case GRANT_SHM:
+            // Only tasks that can write a region may hand it out
+            object = getObject(r0, OBJECT_SHARED);
+            i = getTask(r1);
+            ok = (object != NULL && i != NO_TASK && (object->obj.shm.writers & (1 << taskCurrent)));
+
+            *psp = ok && setSharedAccess(&object->obj.shm, i, *(psp + 2));
+            applyTaskAccess();
+            break;
+        case CREATE_PIPE:
+            *psp = copyTaskName(name, (char *)r1) ? initPipe(r0, name) : INVALID_HANDLE;
+            break;
+        case CONSOLE_WRITE:
+            // a write to the UART0 transmit pipe, the pended UART0 interrupt moves it into the fifo once this returns
+            r0 = getUart0TxPipe();
+            startUart0Tx();
+            // fall through
+        case PIPE_WRITE:
+            // Copy as much as fits in one go, then block and have the wrapper retry the rest once a reader makes room
+            object = getObject(r0, OBJECT_PIPE);
+            *psp = 0;
+            *(psp + 1) = 0;
+            if(object == NULL || !verifyTaskBuffer((void *)r1, *(psp + 2)))
+                return;
+
+            *psp = fillPipe(&object->obj.pip, (uint8_t *)r1, *(psp + 2));
+            if(*psp > 0)
+                wakeAll(&object->obj.pip.readQueue);
+
+            if(*psp < *(psp + 2))
+            {
+                *(psp + 1) = 1;
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);
+                enqueueTask(&object->obj.pip.writeQueue, taskCurrent);
+                tcb[taskCurrent].state = STATE_BLOCKED_PIPE;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            }
+            break;
+        case CONSOLE_WRITE_ALL:
+            // a write to the UART0 transmit pipe that goes in whole or waits for room, so no other output
+            // can land inside it (log frames)
+            object = getObject(getUart0TxPipe(), OBJECT_PIPE);
+            *psp = false;
+            *(psp + 1) = 0;
+            if(object == NULL || *(psp + 2) > object->obj.pip.size || !verifyTaskBuffer((void *)r1, *(psp + 2)))
+                return;
+
+            if((uint32_t)(object->obj.pip.size - object->obj.pip.count) >= *(psp + 2))
+            {
+                fillPipe(&object->obj.pip, (uint8_t *)r1, *(psp + 2));
+                wakeAll(&object->obj.pip.readQueue);
+                startUart0Tx();
+                *psp = true;
+            }
+            else
+            {
+                *(psp + 1) = 1;
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(getUart0TxPipe());
+                enqueueTask(&object->obj.pip.writeQueue, taskCurrent);
+                tcb[taskCurrent].state = STATE_BLOCKED_PIPE;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            }
+            break;
+        case CONSOLE_READ:
+        case CONSOLE_READ_LINE:
+            // a read from the UART0 receive pipe, which the receive interrupt only fills with whole lines,
+            // so a line read stops at the newline
+            r0 = getUart0RxPipe();
+            // fall through
+        case PIPE_READ:
+            // Copy whatever is waiting, up to the requested amount, else block and have the wrapper retry
+            object = getObject(r0, OBJECT_PIPE);
+            *psp = 0;
+            *(psp + 1) = 0;
+            if(object == NULL || !verifyTaskBuffer((void *)r1, *(psp + 2)))
+                return;
+
+            if(svc_num == CONSOLE_READ_LINE)
+                *psp = drainPipeLine(&object->obj.pip, (uint8_t *)r1, *(psp + 2));
+            else
+                *psp = drainPipe(&object->obj.pip, (uint8_t *)r1, *(psp + 2));
+            if(*psp > 0)
+            {
+                wakeAll(&object->obj.pip.writeQueue);
+            }
+            else if(*(psp + 2) > 0)
+            {
+                *(psp + 1) = 1;
+                tcb[taskCurrent].blockedOn = HANDLE_INDEX(r0);
+                enqueueTask(&object->obj.pip.readQueue, taskCurrent);
+                tcb[taskCurrent].state = STATE_BLOCKED_PIPE;
+                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+            }
+            break;
+        case MAP_SHM:
+            object = getObject(r0, OBJECT_SHARED);
+            *psp = 0;
+
+            if(object != NULL && ((object->obj.shm.readers | object->obj.shm.writers) & (1 << taskCurrent)))
+                *psp = (uint32_t)object->obj.shm.base;
             break;
 
     }
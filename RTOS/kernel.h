@@ -25,46 +25,197 @@
 // function pointer
 typedef void (*_fn)();
 
+// software timer callback, run by the timer daemon task
+typedef void (*_timerFn)(uint32_t arg);
+
 // tasks
-#define MAX_TASKS 12
+#define MAX_TASKS 13
+#define STACK_GUARD true // keep a subregion below each stack disabled for its task, so overflows fault
+
+// exception priorities (0 = highest, 7 = lowest)
+// interrupts that call the *FromIsr functions must run at KERNEL_INT_PRIORITY or lower (numerically >=)
+#define KERNEL_INT_PRIORITY 2 // SVCall and SysTick
+#define PENDSV_INT_PRIORITY 7 // context switch runs last (holding off the kernel priority while it switches)
+
+// kernel objects, referenced by handle ((generation << 8) | index)
+typedef uint32_t _handle;
+#define INVALID_HANDLE 0
+#define MAX_KERNEL_OBJECTS 16
 
-// mutex
-#define MAX_MUTEXES 1
-#define MAX_MUTEX_QUEUE_SIZE 2
-#define resource 0
+// kernel object types
+#define OBJECT_FREE      0 // no object
+#define OBJECT_MUTEX     1
+#define OBJECT_SEMAPHORE 2
+#define OBJECT_RWLOCK    3
+#define OBJECT_CONDITION 4
+#define OBJECT_EVENT     5
+#define OBJECT_SHARED    6
+#define OBJECT_PIPE      7
+#define OBJECT_BARRIER   8
+#define OBJECT_TIMER     9
+
+// software timer wheel, must be a power of 2
+#define TIMER_WHEEL_SLOTS 16
+
+// shared memory access, given with grantShared()
+#define SHARED_NONE       0
+#define SHARED_READ       1 // read-only, through the MPU read-only window (one region per task)
+#define SHARED_READ_WRITE 2
 
 typedef struct _MUTEX_INFO
 {
-    char name[16];
     bool lock;
+    bool recursive;
+    uint8_t depth;
     char lockedBy[16];
-    char waiters[MAX_MUTEX_QUEUE_SIZE][16];
+    char waiters[MAX_TASKS][16];
     uint8_t numWaiters;
 } MUTEX_INFO;
 
-// semaphore
-#define MAX_SEMAPHORES 3
-#define MAX_SEMAPHORE_QUEUE_SIZE 2
-#define keyPressed 0
-#define keyReleased 1
-#define flashReq 2
-
 typedef struct _SEMAPHORE_INFO
 {
-    char name[16];
     uint8_t count;
-    char waiters[MAX_SEMAPHORE_QUEUE_SIZE][16];
+    char waiters[MAX_TASKS][16];
     uint8_t numWaiters;
 } SEMAPHORE_INFO;
 
+typedef struct _RWLOCK_INFO
+{
+    uint8_t readers;
+    bool write;
+    char writer[16];
+    char waitingWriters[MAX_TASKS][16];
+    uint8_t numWaitingWriters;
+    uint8_t numWaitingReaders;
+} RWLOCK_INFO;
+
+typedef struct _CONDITION_INFO
+{
+    char waiters[MAX_TASKS][16];
+    uint8_t numWaiters;
+} CONDITION_INFO;
+
+typedef struct _EVENT_INFO
+{
+    uint32_t flags;
+    char waiters[MAX_TASKS][16];
+    uint8_t numWaiters;
+} EVENT_INFO;
+
+typedef struct _SHARED_INFO
+{
+    uint32_t base;
+    uint32_t size;
+    char owner[16];
+    char tasks[MAX_TASKS][16];
+    uint8_t access[MAX_TASKS];
+    uint8_t numTasks;
+} SHARED_INFO;
+
+typedef struct _PIPE_INFO
+{
+    uint16_t size;
+    uint16_t count;
+    char readers[MAX_TASKS][16];
+    uint8_t numReaders;
+    char writers[MAX_TASKS][16];
+    uint8_t numWriters;
+} PIPE_INFO;
+
+typedef struct _BARRIER_INFO
+{
+    uint8_t count;
+    uint8_t arrived;
+    uint32_t phase;
+    char waiters[MAX_TASKS][16];
+    uint8_t numWaiters;
+} BARRIER_INFO;
+
+typedef struct _TIMER_INFO
+{
+    bool active;
+    bool periodic;
+    uint32_t interval;
+    uint32_t remaining;
+    uint32_t overruns;
+} TIMER_INFO;
+
+typedef struct _OBJECT_INFO
+{
+    uint8_t type;
+    _handle handle;
+    char name[16];
+    union
+    {
+        MUTEX_INFO mutex;
+        SEMAPHORE_INFO semaphore;
+        RWLOCK_INFO rwlock;
+        CONDITION_INFO condition;
+        EVENT_INFO event;
+        SHARED_INFO shared;
+        PIPE_INFO pipe;
+        BARRIER_INFO barrier;
+        TIMER_INFO timer;
+    } info;
+} OBJECT_INFO;
+
+// heap block sizes (HEAP_UNIT << order, log2 of the heap units + 1, see the SRAM layout in mm.h)
+// and the heap statistics read by the mem command
+#define HEAP_ORDERS 7
+
+typedef struct _HEAP_INFO
+{
+    uint32_t size;
+    uint32_t unit;                   // size of the smallest block
+    uint32_t freeBytes;
+    uint32_t largestFree;
+    uint8_t freeBlocks[HEAP_ORDERS]; // free blocks of each size (unit << order)
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+} HEAP_INFO;
+
+typedef struct _HEAP_BLOCK
+{
+    uint32_t base;
+    uint32_t size;
+    bool free;
+    char owner[16];
+} HEAP_BLOCK;
+
+// heap call latency, filled by timeHeap() (index 0 = mallocFromHeap, 1 = freeToHeap)
+// bucket 0 counts calls under 32 clocks, bucket b calls under 32 << b clocks, the last bucket the rest
+#define HEAP_LATENCY_BUCKETS 8
+
+typedef struct _HEAP_LATENCY
+{
+    uint32_t calls[2];
+    uint32_t min[2];
+    uint32_t max[2];
+    uint32_t total[2];
+    uint32_t buckets[2][HEAP_LATENCY_BUCKETS];
+    uint32_t failed;
+} HEAP_LATENCY;
+
+// expired timer handed to the timer daemon
+typedef struct _TIMER_EXPIRY
+{
+    _timerFn callback;
+    uint32_t arg;
+} TIMER_EXPIRY;
+
 typedef struct _TASK_INFO
 {
     char name[16];
     uint32_t pid;
     uint8_t state;
     char lockedBy[16];
-    char cpuUsage[16];
+    uint32_t cpuUsage;   // hundredths of a percent
     uint32_t ticks;
+    uint32_t stackBytes;
+    uint32_t stackUsed;  // high-water mark
+    uint32_t heapBytes;
+    uint32_t heapUsed;
 } TASK_INFO;
 
 // task states
@@ -73,32 +224,74 @@ typedef struct _TASK_INFO
 #define STATE_UNRUN             2 // task has never been run
 #define STATE_READY             3 // has run, can resume at any time
 #define STATE_DELAYED           4 // has run, but now awaiting timer
-#define STATE_BLOCKED_MUTEX     5 // has run, but now blocked by semaphore
+#define STATE_BLOCKED_MUTEX     5 // has run, but now blocked by mutex or rwlock
 #define STATE_BLOCKED_SEMAPHORE 6 // has run, but now blocked by semaphore
+#define STATE_BLOCKED_CONDITION 7 // has run, but now waiting on a condition variable
+#define STATE_BLOCKED_EVENT     8 // has run, but now waiting for event flags
+#define STATE_BLOCKED_NOTIFY    9 // has run, but now waiting for a task notification
+#define STATE_BLOCKED_PIPE     10 // has run, but now waiting for data or space in a pipe
+#define STATE_BLOCKED_BARRIER  11 // has run, but now waiting for the rest of a barrier's tasks
+#define STATE_BLOCKED_TIMER    12 // timer daemon, waiting for a timer to expire
+
+// task notification actions
+#define NOTIFY_SET_BITS  0 // or value into the notification word
+#define NOTIFY_INCREMENT 1 // add one to the notification word (value ignored)
+#define NOTIFY_OVERWRITE 2 // replace the notification word with value
 
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
-bool initMutex(uint8_t mutex, const char name[]);
-bool initSemaphore(uint8_t semaphore, uint8_t count, const char name[]);
+_handle initMutex(const char name[]);
+_handle initRecursiveMutex(const char name[]);
+_handle initSemaphore(uint8_t count, const char name[]);
+_handle initRwLock(const char name[]);
+_handle initCondition(const char name[]);
+_handle initEvent(const char name[]);
+_handle initPipe(uint16_t size, const char name[]);
+_handle initBarrier(uint8_t count, const char name[]);
+_handle initTimer(_timerFn callback, uint32_t arg, const char name[]);
+bool setTimer(_handle timer, uint32_t ticks, bool periodic);
+bool destroyObject(_handle handle);
+_handle findObject(const char name[]);
 
 void initRtos(void);
 void startRtos(void);
 
-bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes);
+bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes, uint32_t heapBytes);
 void restartThread(_fn fn);
 void stopThread(_fn fn);
-void setThreadPriority(_fn fn, uint8_t priority);
+bool deleteThread(_fn fn);
+bool isStackOverflow(void);
+uint8_t setThreadPriority(_fn fn, uint8_t priority);
 
 void yield(void);
 void sleep(uint32_t tick);
-void lock(int8_t mutex);
-void unlock(int8_t mutex);
-void wait(int8_t semaphore);
-void post(int8_t semaphore);
+bool lock(_handle mutex);   // SVC wrappers in asm.s
+bool unlock(_handle mutex);
+void wait(_handle semaphore);
+void post(_handle semaphore);
+bool readLock(_handle rwlock);   // SVC wrappers in asm.s
+bool readUnlock(_handle rwlock);
+bool writeLock(_handle rwlock);
+bool writeUnlock(_handle rwlock);
+bool waitCondition(_handle condition, _handle mutex);
+void signalCondition(_handle condition);
+void broadcastCondition(_handle condition);
+void setEvent(_handle event, uint32_t flags);
+void notify(_handle task, uint32_t value, uint8_t action);
+void startTimer(_handle timer, uint32_t ticks, bool periodic);
+void stopTimer(_handle timer);
+void resetTimer(_handle timer);
 uint32_t getCurrentPid();
 
+bool postFromIsr(_handle semaphore);
+bool setEventFromIsr(_handle event, uint32_t flags);
+bool notifyFromIsr(_handle task, uint32_t value, uint8_t action);
+uint32_t pipeWriteFromIsr(_handle pipe, const void* data, uint32_t n);
+bool pipeWriteAllFromIsr(_handle pipe, const void* data, uint32_t n);
+uint32_t pipeReadFromIsr(_handle pipe, void* data, uint32_t n);
+
 void systickIsr(void);
 void __attribute__((naked)) pendSvIsr(void);
 void svCallIsr(void);
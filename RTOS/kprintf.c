@@ -0,0 +1,241 @@
+// Formatted output functions
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// kprintf formats into a buffer on the calling task's stack and hands it to the UART in one write when it
+// fills or the format ends, instead of a call per fragment. Numbers are converted with 32-bit divides
+// (hex with shifts) straight into the output, there is no 64-bit math or intermediate string copy
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include "uart0.h"
+#include "kprintf.h"
+
+// where formatted characters go: the UART (flushed when full) or a caller's string (truncated when full)
+typedef struct _OUTPUT
+{
+    char* buffer;
+    uint32_t size;
+    uint32_t length;
+    uint32_t total;   // characters produced, including any truncated
+    bool console;
+} OUTPUT;
+
+// one conversion's flags, width and precision
+typedef struct _FIELD
+{
+    bool left;
+    bool zero;
+    uint8_t width;
+    uint8_t precision;
+} FIELD;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void putOutput(OUTPUT* out, char c)
+{
+    out->total++;
+    if(out->console)
+    {
+        out->buffer[out->length++] = c;
+        if(out->length == out->size)
+        {
+            putnUart0(out->buffer, out->length);
+            out->length = 0;
+        }
+    }
+    else if(out->length + 1 < out->size)
+        out->buffer[out->length++] = c;
+}
+
+void padOutput(OUTPUT* out, char c, uint8_t count)
+{
+    while(count-- > 0)
+        putOutput(out, c);
+}
+
+// Converts a number least significant digit first, inserting the fixed-point decimal point
+// after precision digits, then writes it out with its sign and padding
+void putNumber(OUTPUT* out, uint32_t value, bool negative, uint8_t base, bool upper, FIELD* field)
+{
+    const char* hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char digits[12]; // 10 decimal digits and a decimal point (precision is at most KPRINTF_PRECISION)
+    uint8_t n = 0;
+    uint8_t length;
+
+    do
+    {
+        if(base == 16)
+        {
+            digits[n++] = hex[value & 0xF];
+            value >>= 4;
+        }
+        else
+        {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        }
+        if(field->precision != 0 && n == field->precision)
+            digits[n++] = '.';
+    } while(value != 0 || (field->precision != 0 && n <= field->precision + 1));
+
+    length = n + negative;
+    if(!field->left && !field->zero && field->width > length)
+        padOutput(out, ' ', field->width - length);
+    if(negative)
+        putOutput(out, '-');
+    if(!field->left && field->zero && field->width > length)
+        padOutput(out, '0', field->width - length);
+    while(n > 0)
+        putOutput(out, digits[--n]);
+    if(field->left && field->width > length)
+        padOutput(out, ' ', field->width - length);
+}
+
+void putString(OUTPUT* out, const char* str, FIELD* field)
+{
+    uint8_t length = 0;
+
+    while(str[length] != '\0' && length < 255)
+        length++;
+
+    if(!field->left && field->width > length)
+        padOutput(out, ' ', field->width - length);
+    while(*str != '\0')
+        putOutput(out, *str++);
+    if(field->left && field->width > length)
+        padOutput(out, ' ', field->width - length);
+}
+
+void formatOutput(OUTPUT* out, const char format[], va_list args)
+{
+    FIELD field;
+    int32_t value;
+    const char* str;
+    char c;
+
+    while((c = *format++) != '\0')
+    {
+        if(c != '%')
+        {
+            putOutput(out, c);
+            continue;
+        }
+
+        field.left = false;
+        field.zero = false;
+        field.width = 0;
+        field.precision = 0;
+
+        for(; *format == '-' || *format == '0'; format++)
+        {
+            if(*format == '-')
+                field.left = true;
+            else
+                field.zero = true;
+        }
+        for(; *format >= '0' && *format <= '9'; format++)
+            field.width = field.width * 10 + (*format - '0');
+        if(*format == '.')
+        {
+            for(format++; *format >= '0' && *format <= '9'; format++)
+                field.precision = field.precision * 10 + (*format - '0');
+            if(field.precision > KPRINTF_PRECISION)
+                field.precision = KPRINTF_PRECISION;
+        }
+        if(*format == 'l')
+            format++;
+
+        switch(c = *format++)
+        {
+            case 'd':
+                value = va_arg(args, int32_t);
+                putNumber(out, (value < 0) ? 0 - (uint32_t)value : (uint32_t)value, value < 0, 10, false, &field);
+                break;
+            case 'u':
+                putNumber(out, va_arg(args, uint32_t), false, 10, false, &field);
+                break;
+            case 'x':
+            case 'X':
+                field.precision = 0;
+                putNumber(out, va_arg(args, uint32_t), false, 16, c == 'X', &field);
+                break;
+            case 'c':
+                putOutput(out, (char)va_arg(args, int));
+                break;
+            case 's':
+                str = va_arg(args, const char*);
+                putString(out, (str != NULL) ? str : "(null)", &field);
+                break;
+            case '\0':
+                format--;
+                break;
+            default:
+                putOutput(out, c);
+                break;
+        }
+    }
+}
+
+// Formats to the UART through a KPRINTF_BUFFER byte buffer on the caller's stack
+void kprintf(const char format[], ...)
+{
+    char buffer[KPRINTF_BUFFER];
+    OUTPUT out;
+    va_list args;
+
+    out.buffer = buffer;
+    out.size = KPRINTF_BUFFER;
+    out.length = 0;
+    out.total = 0;
+    out.console = true;
+
+    va_start(args, format);
+    formatOutput(&out, format, args);
+    va_end(args);
+
+    if(out.length > 0)
+        putnUart0(buffer, out.length);
+}
+
+// Formats into a string of size bytes (always null terminated), returns the length the full output would have
+uint32_t kvsnprintf(char buffer[], uint32_t size, const char format[], va_list args)
+{
+    OUTPUT out;
+
+    out.buffer = buffer;
+    out.size = size;
+    out.length = 0;
+    out.total = 0;
+    out.console = false;
+
+    formatOutput(&out, format, args);
+    if(size > 0)
+        buffer[out.length] = '\0';
+    return out.total;
+}
+
+uint32_t ksnprintf(char buffer[], uint32_t size, const char format[], ...)
+{
+    uint32_t total;
+    va_list args;
+
+    va_start(args, format);
+    total = kvsnprintf(buffer, size, format, args);
+    va_end(args);
+    return total;
+}
@@ -0,0 +1,34 @@
+// Formatted output functions
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef KPRINTF_H_
+#define KPRINTF_H_
+
+#include <stdint.h>
+#include <stdarg.h>
+
+// output is gathered on the caller's stack and written to the UART this many bytes at a time
+#define KPRINTF_BUFFER 64
+
+// largest precision honored, a longer one is cut to this (a 32-bit value has at most 10 digits)
+#define KPRINTF_PRECISION 9
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Conversions: %d %u %x %X %c %s %%, with optional flags ('-' left justify, '0' zero pad),
+// a field width, and for %d/%u a precision giving the digits after a fixed-point decimal point
+// (kprintf("%.2u", 1234) prints 12.34)
+void kprintf(const char format[], ...);
+uint32_t ksnprintf(char buffer[], uint32_t size, const char format[], ...);
+uint32_t kvsnprintf(char buffer[], uint32_t size, const char format[], va_list args);
+
+#endif
@@ -0,0 +1,114 @@
+// Binary log functions
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// LOG0/1/2 store a record (the address of a format string kept in the .logstr section, a timestamp and
+// two arguments) in a ring every task can write, so logging costs a slot reservation and four stores
+// instead of formatting and waiting on the UART. The drain task sends the raw records when the system
+// is otherwise idle and tools/logdecode.py turns them back into text with the strings in RTOS.out
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel.h"
+#include "uart0.h"
+#include "asm.h"
+#include "bench.h"
+#include "log.h"
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initLog(void)
+{
+    uint32_t* word = (uint32_t *)LOG_BASE;
+    uint32_t i;
+
+    for(i = 0; i < LOG_BYTES / sizeof(uint32_t); i++)
+        word[i] = 0;
+}
+
+// Fills a reserved record, writing the id last so the drain task never sends a half written one.
+// The ring's control words are task writable, so privileged callers only ever store to a slot inside it
+// (logReserve returns 0xFFFFFFFF when the ring is full)
+void logWrite(uint32_t id, uint32_t a, uint32_t b)
+{
+    LOG_RING* ring = (LOG_RING *)LOG_BASE;
+    LOG_RECORD* record;
+    uint32_t slot = logReserve(&ring->head, LOG_RECORDS);
+
+    if(slot >= LOG_RECORDS)
+    {
+        ring->dropped++;
+        return;
+    }
+
+    record = &ring->records[slot];
+    record->time = readBenchTimer();
+    record->args[0] = a;
+    record->args[1] = b;
+    record->id = id;
+}
+
+void sendLogRecord(const LOG_RECORD* record)
+{
+    char frame[1 + sizeof(LOG_RECORD)];
+    const uint8_t* bytes = (const uint8_t *)record;
+    uint8_t i;
+
+    frame[0] = LOG_FRAME_MAGIC;
+    for(i = 0; i < sizeof(LOG_RECORD); i++)
+        frame[i + 1] = bytes[i];
+
+    // the frame goes into the transmit pipe whole so the decoder never sees other output inside it
+    // (without a transmit pipe it can only be written as it is)
+    if(!consoleWriteAll(frame, sizeof(frame)))
+        putnUart0(frame, sizeof(frame));
+}
+
+// Sends finished records in order, then how many were dropped since the last report,
+// and sleeps when the ring is empty or its oldest record is still being written
+void logDrain(void)
+{
+    LOG_RING* ring = (LOG_RING *)LOG_BASE;
+    LOG_RECORD record;
+    uint32_t dropped;
+
+    while(true)
+    {
+        // any task can scribble on the control words, put them back inside the ring
+        if(ring->tail >= LOG_RECORDS)
+            ring->tail = 0;
+        if(ring->head >= LOG_RECORDS)
+            ring->head = ring->tail;
+        if(ring->tail != ring->head && ring->records[ring->tail].id != 0)
+        {
+            sendLogRecord(&ring->records[ring->tail]);
+            ring->records[ring->tail].id = 0;
+            ring->tail = (ring->tail + 1 == LOG_RECORDS) ? 0 : ring->tail + 1;
+            continue;
+        }
+
+        dropped = ring->dropped;
+        if(dropped != ring->reported)
+        {
+            record.id = LOG_DROPPED_ID;
+            record.time = readBenchTimer();
+            record.args[0] = dropped - ring->reported;
+            record.args[1] = 0;
+            sendLogRecord(&record);
+            ring->reported = dropped;
+        }
+        sleep(LOG_DRAIN_MS);
+    }
+}
@@ -0,0 +1,62 @@
+// Binary log functions
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mm.h"
+
+// a log record: the address of its format string in .logstr (0 while the record is being written),
+// the bench timer clocks when it was logged and two raw arguments
+typedef struct _LOG_RECORD
+{
+    uint32_t id;
+    uint32_t time;
+    uint32_t args[2];
+} LOG_RECORD;
+
+// the ring fills the LOG_BYTES at LOG_BASE (see the SRAM layout in mm.h), one record is always left
+// empty so head == tail means empty
+#define LOG_RECORDS ((LOG_BYTES - 16) / sizeof(LOG_RECORD))
+
+typedef struct _LOG_RING
+{
+    uint32_t head;     // next record a writer reserves (logReserve in asm.s reads tail right after it)
+    uint32_t tail;     // next record the drain task sends
+    uint32_t dropped;  // records lost to a full ring (approximate, writers do not lock it)
+    uint32_t reported; // dropped count last sent by the drain task
+    LOG_RECORD records[LOG_RECORDS];
+} LOG_RING;
+
+// each record is sent as LOG_FRAME_MAGIC and the record's bytes (little endian), between console text
+#define LOG_FRAME_MAGIC 0x1E
+#define LOG_DROPPED_ID  1    // record sent in place of the ones that were dropped (args[0] = count)
+
+// drain task poll interval when the ring is empty, in ms
+#define LOG_DRAIN_MS 50
+
+// Records a format string ID and up to two arguments, formatted later on the host by tools/logdecode.py
+// from the .logstr section of the linked image. Safe from tasks, ISRs and the kernel
+#define LOG2(format, a, b) do { static const char logFormat[] __attribute__((section(".logstr"))) = format; \
+                                logWrite((uint32_t)logFormat, (uint32_t)(a), (uint32_t)(b)); } while(0)
+#define LOG1(format, a) LOG2(format, a, 0)
+#define LOG0(format)    LOG2(format, 0, 0)
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initLog(void);
+void logWrite(uint32_t id, uint32_t a, uint32_t b);
+void logDrain(void);
+
+#endif
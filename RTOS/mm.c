@@ -16,293 +16,460 @@
 #include <stdbool.h>
 #include "tm4c123gh6pm.h"
 #include "mm.h"
+#include "bench.h"
+
+// Buddy heap over the task regions in HEAP_UNIT pieces. A block of order k is HEAP_UNIT << k bytes and
+// aligned to its size, so it always covers whole MPU subregions
+#define HEAP_BASE    (LOG_BASE + LOG_BYTES)
+#define HEAP_TOP     SRAM_TOP
+#define HEAP_UNITS   ((SRAM_TOP - SRAM_BASE) / HEAP_UNIT) // units from SRAM_BASE to HEAP_TOP
+#define BUDDY_ORDERS HEAP_ORDERS
+
+static uint64_t freeMap[BUDDY_ORDERS]; // bit i = block i of that order is free
+static uint64_t fineMap[BUDDY_ORDERS]; // bit i = block i of that order has HEAP_UNIT subregions in it
+static uint8_t blockOrder[HEAP_UNITS]; // order + 1 of the allocation starting at each unit, 0 if none
+
+// Task region and subregion bit of each unit, built once at boot so srd masks are an OR over units
+// (NUM_SRAM_REGIONS for kernel SRAM, which heap blocks never include)
+static uint8_t unitRegion[HEAP_UNITS];
+static uint8_t unitSubregion[HEAP_UNITS];
+
+static uint32_t freeBytes;
+static uint32_t largestSubregion;
+static uint32_t heapAllocations;
+static uint32_t heapFrees;
+static uint32_t heapFailures;
+
+// heap benchmark state kept between the SVCs it runs in (see measureHeapLatency)
+static void *benchHeld[HEAP_BENCH_SLOTS];
+static uint32_t benchSeed;
+static uint16_t benchRound;
 
 typedef struct
 {
+    uint32_t address;
     uint32_t size;
-    bool free;
-    void* address;
-}_block;
-
-#define NUM_BLOCKS 36
-
-static _block heap[NUM_BLOCKS];
-
-typedef struct
-{
-    uint16_t size;
-    uint32_t* address;
     uint8_t region_number;
 }_region;
 
-static _region SRAM[NUM_SRAM_REGIONS];
+#define REGION_ENTRY(base, size, region) { base, size, region },
+static const _region SRAM[NUM_SRAM_REGIONS] = { SRAM_REGIONS(REGION_ENTRY) };
+
+// Fails to compile (negative array size) unless each task region is a power of 2 aligned to its size,
+// has subregions a multiple of HEAP_UNIT and lies between kernel SRAM and SRAM_TOP
+#define REGION_CHECK(base, size, region) \
+    typedef char regionLayout##region[((size) & ((size) - 1)) == 0 && (base) % (size) == 0 && \
+                                      (size) % (8 * HEAP_UNIT) == 0 && (base) >= SRAM_BASE + KERNEL_SRAM_BYTES && \
+                                      (base) + (size) <= SRAM_TOP ? 1 : -1];
+SRAM_REGIONS(REGION_CHECK)
 
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
-// REQUIRED: add your malloc code here and update the SRD bits for the current thread
+// Returns the index of the lowest set bit (map must not be 0)
+static uint8_t lowestBit(uint64_t map)
+{
+    uint32_t word = (uint32_t)map;
+
+    if(word != 0)
+        return 31 - _norm(word & -word);
+    word = (uint32_t)(map >> 32);
+    return 63 - _norm(word & -word);
+}
+
+// Takes the lowest free block of the given order, splitting the smallest larger block if none is free.
+// With fine set only blocks that can be split down to a HEAP_UNIT subregion are used
+static bool takeBlock(uint8_t order, bool fine, uint8_t *index)
+{
+    uint64_t map = 0;
+    uint8_t k;
+    uint8_t i;
+
+    for(k = order; k < BUDDY_ORDERS && map == 0; k++)
+        map = freeMap[k] & (fine ? fineMap[k] : ~(uint64_t)0);
+    if(map == 0)
+        return false;
+
+    k--;
+    i = lowestBit(map);
+    freeMap[k] &= ~((uint64_t)1 << i);
+
+    // Keep one half of each split and free the other
+    while(k > order)
+    {
+        k--;
+        i <<= 1;
+        if(fine && !(fineMap[k] & ((uint64_t)1 << i)))
+            i++;
+        freeMap[k] |= (uint64_t)1 << (i ^ 1);
+    }
+
+    *index = i;
+    return true;
+}
+
+// Returns the smallest order that holds size_in_bytes (BUDDY_ORDERS if none does)
+static uint8_t orderFor(uint32_t size_in_bytes)
+{
+    uint8_t order = 0;
+
+    while(order < BUDDY_ORDERS && ((uint32_t)HEAP_UNIT << order) < size_in_bytes)
+        order++;
+    return order;
+}
+
+// Takes a block of the given order and records it as allocated, returns 0 if none is free
+static void * allocateBlock(uint8_t order, bool fine)
+{
+    uint8_t index;
+
+    if(order == BUDDY_ORDERS || !takeBlock(order, fine, &index))
+        return 0;
+
+    blockOrder[index << order] = order + 1;
+    freeBytes -= HEAP_UNIT << order;
+    return (void *)(SRAM_BASE + (index << order) * HEAP_UNIT);
+}
+
+// Allocates the smallest buddy block that fits. A HEAP_UNIT request falls back to a block twice the size
+// when no HEAP_UNIT subregion is free
 void * mallocFromHeap(uint32_t size_in_bytes)
 {
-   uint8_t i;
-   if(size_in_bytes <= 512)
-   {
-       for(i = 8; i < NUM_BLOCKS; i++)
-       {
-           if(heap[i].size == 512 && heap[i].free)
-           {
-               heap[i].free = false;
-               return heap[i].address;
-           }
-       }
-
-   }
-   else if(size_in_bytes <= 1024)
-   {
-       for(i = 0; i < NUM_BLOCKS; i++)
-       {
-           if(heap[i].size == 1024 && heap[i].free)
-           {
-               heap[i].free = false;
-               return heap[i].address;
-           }
-       }
-   }
-   else if(size_in_bytes <= 1536)
-   {
-       if(heap[7].free)
-       {
-           heap[7].free = false;
-           return heap[7].address;
-       }
-       else if(heap[22].free)
-       {
-           heap[22].free = false;
-           return heap[22].address;
-       }
-       else if(heap[29].free)
-       {
-           heap[29].free = false;
-           return heap[29].address;
-       }
-   }
-
-   int8_t temp_index = -1;
-   int8_t j;
-   int16_t size_needed = size_in_bytes;
-   int8_t num_blocks = 0;
-
-   // If bigger than 1536
-   for(i = 0; i < NUM_BLOCKS; i++)
-   {
-       if(heap[i].free && heap[i].size == 1024)
-       {
-           if(temp_index == -1)
-           {
-               temp_index = i;
-               size_needed = size_in_bytes - 1024;
-               num_blocks++;
-           }
-           else if(temp_index != -1 && size_needed > 0)
-           {
-               num_blocks++;
-               size_needed -= 1024;
-           }
-       }
-       else if(size_needed > 0)
-       {
-           num_blocks = 0;
-           temp_index = -1;
-           size_needed = size_in_bytes;
-       }
-       else if(size_needed <= 0)
-       {
-           heap[temp_index].free = false;
-           for(j = 1; j < num_blocks; j++)
-           {
-               heap[temp_index + j].free = false;
-           }
-           return heap[temp_index + j - 1].address;
-       }
-   }
-   if(size_needed <= 0)
-   {
-       heap[temp_index].free = false;
-       for(j = 1; j < num_blocks; j++)
-       {
-           heap[temp_index + j].free = false;
-       }
-       return heap[temp_index + j - 1].address;
-   }
-   else
-   {
-      num_blocks = 0;
-      temp_index = -1;
-      size_needed = size_in_bytes;
-   }
-
-   for(i = 8; i < NUM_BLOCKS; i++)
-   {
-      if(heap[i].free && heap[i].size == 512)
-      {
-          if(temp_index == -1)
-          {
-              temp_index = i;
-              size_needed = size_in_bytes - 512;
-              num_blocks++;
-          }
-          else if(temp_index != -1 && size_needed > 0)
-          {
-              num_blocks++;
-              size_needed -= 512;
-          }
-      }
-      else if(size_needed > 0)
-      {
-          num_blocks = 0;
-          temp_index = -1;
-          size_needed = size_in_bytes;
-      }
-      else if(size_needed <= 0)
-      {
-          heap[temp_index].free = false;
-          for(j = 1; j < num_blocks; j++)
-          {
-              heap[temp_index + j].free = false;
-          }
-          return heap[temp_index + j - 1].address;
-      }
-   }
-   if(size_needed <= 0)
-   {
-       heap[temp_index].free = false;
-       for(j = 1; j < num_blocks; j++)
-       {
-           heap[temp_index + j].free = false;
-       }
-       return heap[temp_index + j - 1].address;
-   }
-   else
-   {
-      num_blocks = 0;
-      temp_index = -1;
-      size_needed = size_in_bytes;
-   }
-
-
-   // Catch the rest
-   for(i = 0; i < NUM_BLOCKS; i++)
-   {
-       if(heap[i].free)
-       {
-           if(temp_index == -1)
-           {
-               temp_index = i;
-               size_needed = size_in_bytes - heap[i].size;
-               num_blocks++;
-           }
-           else if(temp_index != -1 && size_needed > 0)
-           {
-               num_blocks++;
-               size_needed -= heap[i].size;
-           }
-       }
-       else if(size_needed > 0)
-       {
-           num_blocks = 0;
-           temp_index = -1;
-           size_needed = size_in_bytes;
-       }
-       else if(size_needed <= 0)
-       {
-           heap[temp_index].free = false;
-           for(j = 1; j < num_blocks; j++)
-           {
-               heap[temp_index + j].free = false;
-           }
-           return heap[temp_index + j - 1].address;
-       }
-   }
-   if(size_needed <= 0)
-   {
-       heap[temp_index].free = false;
-       for(j = 1; j < num_blocks; j++)
-       {
-           heap[temp_index + j].free = false;
-       }
-       return heap[temp_index + j - 1].address;
-   }
-
-   return 0;
+    uint8_t order = orderFor(size_in_bytes);
+    void *ptr = 0;
+
+    if(size_in_bytes != 0 && size_in_bytes <= freeBytes)
+    {
+        if(order == 0)
+            ptr = allocateBlock(order++, true);
+        if(ptr == 0)
+            ptr = allocateBlock(order, false);
+    }
+
+    if(ptr != 0)
+        heapAllocations++;
+    else
+        heapFailures++;
+    return ptr;
 }
 
-// REQUIRED: add your custom MPU functions here (eg to return the srd bits)
-void generateSramSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS], void *baseAdd, uint32_t size_in_bytes)
+// Allocates a block with room for size_in_bytes above a guard of one subregion at its bottom, and returns
+// the guard size. Blocks with HEAP_UNIT subregions are tried first, larger subregions make a larger guard
+void * mallocGuardedFromHeap(uint32_t size_in_bytes, uint32_t *guardBytes)
+{
+    void *ptr = 0;
+
+    if(size_in_bytes != 0 && size_in_bytes + HEAP_UNIT <= freeBytes)
+    {
+        ptr = allocateBlock(orderFor(size_in_bytes + HEAP_UNIT), true);
+        if(ptr == 0)
+            ptr = allocateBlock(orderFor(size_in_bytes + largestSubregion), false);
+    }
+
+    if(ptr != 0)
+    {
+        *guardBytes = getSubregionSize(ptr);
+        heapAllocations++;
+    }
+    else
+        heapFailures++;
+    return ptr;
+}
+
+// Returns an allocation from mallocFromHeap to the heap, merging it with its free buddies,
+// fails if ptr is not the base of one
+bool freeToHeap(void *ptr)
+{
+    uint32_t unit = ((uint32_t)ptr - SRAM_BASE) / HEAP_UNIT;
+    uint8_t order;
+    uint8_t index;
+
+    if((uint32_t)ptr < HEAP_BASE || (uint32_t)ptr >= HEAP_TOP || (uint32_t)ptr % HEAP_UNIT != 0 || blockOrder[unit] == 0)
+        return false;
+
+    order = blockOrder[unit] - 1;
+    index = unit >> order;
+    blockOrder[unit] = 0;
+    freeBytes += HEAP_UNIT << order;
+    heapFrees++;
+
+    while(order < BUDDY_ORDERS - 1 && (freeMap[order] & ((uint64_t)1 << (index ^ 1))))
+    {
+        freeMap[order] &= ~((uint64_t)1 << (index ^ 1));
+        index >>= 1;
+        order++;
+    }
+    freeMap[order] |= (uint64_t)1 << index;
+    return true;
+}
+
+// Returns the number of free bytes left in the heap
+uint32_t getFreeHeap(void)
 {
+    return freeBytes;
+}
+
+// Builds the srd masks that enable exactly the block of the given order and index
+void buddySrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS], uint8_t order, uint8_t index)
+{
+    uint8_t unit = index << order;
+    uint8_t end = unit + (1 << order);
     uint8_t i;
-    uint8_t j;
-    uint8_t srd_mask = 0xFF;
-    bool reached = 0;
 
     for(i = 0; i < NUM_SRAM_REGIONS; i++)
+        srdMask[i] = 0xFF;
+
+    for(; unit < end; unit++)
+        srdMask[unitRegion[unit]] &= ~unitSubregion[unit];
+}
+
+// Fills the free space by block size, the largest free block and the call counters
+void getHeapStats(HEAP_INFO *info)
+{
+    uint64_t map;
+    uint8_t k;
+
+    info->size = HEAP_TOP - HEAP_BASE;
+    info->unit = HEAP_UNIT;
+    info->freeBytes = freeBytes;
+    info->largestFree = 0;
+    for(k = 0; k < BUDDY_ORDERS; k++)
     {
-        NVIC_MPU_NUMBER_R |= NVIC_MPU_NUMBER_M; // Set region to 7 (to avoid accidental change)
-        NVIC_MPU_NUMBER_R &= 0xFFFFFFF8 | SRAM[i].region_number; // Set to region
+        info->freeBlocks[k] = 0;
+        for(map = freeMap[k]; map != 0; map &= map - 1)
+            info->freeBlocks[k]++;
+
+        if(freeMap[k] != 0)
+            info->largestFree = HEAP_UNIT << k;
+    }
+    info->allocations = heapAllocations;
+    info->frees = heapFrees;
+    info->failures = heapFailures;
+}
+
+// Gets the nth block of the heap in address order, allocated or free (owner is left to the caller),
+// fails past the last block
+bool getHeapBlock(uint8_t n, HEAP_BLOCK *block)
+{
+    uint32_t unit = (HEAP_BASE - SRAM_BASE) / HEAP_UNIT;
+    uint8_t order = 0;
+    bool free = false;
 
-        if(((uint32_t)baseAdd < (uint32_t)SRAM[i].address + SRAM[i].size) && ((uint32_t)baseAdd + size_in_bytes > (uint32_t)SRAM[i].address))
+    while(unit < HEAP_UNITS)
+    {
+        if(blockOrder[unit] != 0)
         {
-            for(j = 0; j < 8; j++)
+            order = blockOrder[unit] - 1;
+            free = false;
+        }
+        else
+        {
+            // a free block starts here, find its order
+            for(order = 0; order < BUDDY_ORDERS; order++)
             {
-                if(!reached)
-                {
-                    if((uint32_t)baseAdd >= ((uint32_t)SRAM[i].address + (j*SRAM[i].size/8)) && (uint32_t)baseAdd < ((uint32_t)SRAM[i].address + ((j+1)*SRAM[i].size/8)))
-                    {
-                        reached = true;
-                        srd_mask &= ~(0x01 << j);
-                    }
-                }
-                else if(((uint32_t)baseAdd + size_in_bytes) > ((uint32_t)SRAM[i].address + (j*SRAM[i].size/8)) && reached)
-                {
-                    srd_mask &= ~(0x01 << j);
-                }
+                if((unit & ((1 << order) - 1)) == 0 && (freeMap[order] & ((uint64_t)1 << (unit >> order))))
+                    break;
             }
+            free = true;
+        }
+
+        if(n-- == 0)
+            break;
+        unit += 1 << order;
+    }
+    if(unit >= HEAP_UNITS)
+        return false;
+
+    block->base = SRAM_BASE + unit * HEAP_UNIT;
+    block->size = HEAP_UNIT << order;
+    block->free = free;
+    return true;
+}
+
+// Returns the size of the MPU subregion holding an address (0 outside the SRAM regions)
+uint32_t getSubregionSize(void *address)
+{
+    uint8_t i;
+
+    for(i = 0; i < NUM_SRAM_REGIONS; i++)
+    {
+        if((uint32_t)address >= SRAM[i].address && (uint32_t)address < SRAM[i].address + SRAM[i].size)
+            return SRAM[i].size / 8;
+    }
+    return 0;
+}
+
+// Builds the srd masks for a heap allocation from its order and index, returns the size of its block
+// (0 if ptr is not the base of an allocation)
+uint32_t generateHeapSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS], void *ptr)
+{
+    uint32_t unit = ((uint32_t)ptr - SRAM_BASE) / HEAP_UNIT;
+    uint8_t order;
+
+    if((uint32_t)ptr < HEAP_BASE || (uint32_t)ptr >= HEAP_TOP || (uint32_t)ptr % HEAP_UNIT != 0 || blockOrder[unit] == 0)
+        return 0;
+
+    order = blockOrder[unit] - 1;
+    buddySrdMasks(srdMask, order, unit >> order);
+    return HEAP_UNIT << order;
+}
+
+// Adds one call of the given cycles to the latency histogram
+static void recordLatency(HEAP_LATENCY *latency, uint8_t op, uint32_t cycles)
+{
+    uint8_t bucket = (cycles < 32) ? 0 : 31 - _norm(cycles) - 4;
+
+    if(bucket >= HEAP_LATENCY_BUCKETS)
+        bucket = HEAP_LATENCY_BUCKETS - 1;
+
+    if(latency->calls[op] == 0 || cycles < latency->min[op])
+        latency->min[op] = cycles;
+    if(cycles > latency->max[op])
+        latency->max[op] = cycles;
+    latency->calls[op]++;
+    latency->total[op] += cycles;
+    latency->buckets[op][bucket]++;
+}
+
+// Frees whatever the heap benchmark still holds
+static void releaseBenchBlocks(void)
+{
+    uint8_t slot;
+
+    for(slot = 0; slot < HEAP_BENCH_SLOTS; slot++)
+    {
+        if(benchHeld[slot] != 0)
+            freeToHeap(benchHeld[slot]);
+        benchHeld[slot] = 0;
+    }
+}
+
+// Times random mallocFromHeap and freeToHeap calls (1 to 3072 bytes, up to HEAP_BENCH_SLOTS held at once)
+// against whatever the running tasks already hold. Each call runs the next HEAP_BENCH_CHUNK rounds so the
+// kernel never holds off SysTick for the whole run, restart begins a new run (freeing anything an interrupted
+// one held). Returns true once all HEAP_BENCH_ROUNDS are done and everything allocated here is freed.
+// The benchmark's calls are left out of the heap statistics
+bool measureHeapLatency(HEAP_LATENCY *latency, bool restart)
+{
+    uint32_t allocations = heapAllocations;
+    uint32_t frees = heapFrees;
+    uint32_t failures = heapFailures;
+    uint32_t start;
+    uint32_t cycles;
+    uint16_t i;
+    uint8_t slot;
+
+    if(restart)
+    {
+        releaseBenchBlocks();
+        for(i = 0; i < sizeof(HEAP_LATENCY) / sizeof(uint32_t); i++)
+            ((uint32_t *)latency)[i] = 0;
+        benchSeed = 1;
+        benchRound = 0;
+    }
+
+    for(i = 0; i < HEAP_BENCH_CHUNK && benchRound < HEAP_BENCH_ROUNDS; i++, benchRound++)
+    {
+        benchSeed = benchSeed * 1664525 + 1013904223;
+        slot = (benchSeed >> 24) % HEAP_BENCH_SLOTS;
+
+        if(benchHeld[slot] == 0)
+        {
+            start = readBenchTimer();
+            benchHeld[slot] = mallocFromHeap((benchSeed >> 8) % 3072 + 1);
+            cycles = readBenchTimer() - start;
+
+            recordLatency(latency, 0, cycles);
+            if(benchHeld[slot] == 0)
+                latency->failed++;
         }
         else
         {
-            srd_mask = 0xFF;
+            start = readBenchTimer();
+            freeToHeap(benchHeld[slot]);
+            cycles = readBenchTimer() - start;
+
+            recordLatency(latency, 1, cycles);
+            benchHeld[slot] = 0;
         }
+    }
+
+    if(benchRound == HEAP_BENCH_ROUNDS)
+        releaseBenchBlocks();
 
-        srdMask[i] = srd_mask;
+    heapAllocations = allocations;
+    heapFrees = frees;
+    heapFailures = failures;
+    return benchRound == HEAP_BENCH_ROUNDS;
+}
 
-        srd_mask = 0xFF;
+// REQUIRED: add your custom MPU functions here (eg to return the srd bits)
+// Builds the srd masks that enable every subregion the buffer touches, from the unit table built at boot
+void generateSramSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS], void *baseAdd, uint32_t size_in_bytes)
+{
+    uint32_t start = (uint32_t)baseAdd;
+    uint32_t end = start + size_in_bytes;
+    uint32_t unit;
+    uint8_t i;
+
+    for(i = 0; i < NUM_SRAM_REGIONS; i++)
+        srdMask[i] = 0xFF;
+
+    if(size_in_bytes == 0 || start >= SRAM_TOP || end <= SRAM_BASE)
+        return;
+    if(start < SRAM_BASE)
+        start = SRAM_BASE;
+    if(end > SRAM_TOP)
+        end = SRAM_TOP;
+
+    for(unit = (start - SRAM_BASE) / HEAP_UNIT; unit <= (end - 1 - SRAM_BASE) / HEAP_UNIT; unit++)
+    {
+        if(unitRegion[unit] < NUM_SRAM_REGIONS)
+            srdMask[unitRegion[unit]] &= ~unitSubregion[unit];
     }
 }
 
 void applySramSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS])
 {
-    // Function should take no longer than 70ish clks = 1.75us GOOD
-    // Set for all 5, don't loop to avoid loss in time (10clks = 250ns = .25us)
-    NVIC_MPU_NUMBER_R = SRAM[0].region_number; // Set to region
-    NVIC_MPU_ATTR_R &= 0xFFFF00FF;
-    NVIC_MPU_ATTR_R |= ((uint16_t)srdMask[0] << 8);
-
-    NVIC_MPU_NUMBER_R = SRAM[1].region_number; // Set to region
-    NVIC_MPU_ATTR_R &= 0xFFFF00FF;
-    NVIC_MPU_ATTR_R |= ((uint16_t)srdMask[1] << 8);
-
-    NVIC_MPU_NUMBER_R = SRAM[2].region_number; // Set to region
-    NVIC_MPU_ATTR_R &= 0xFFFF00FF;
-    NVIC_MPU_ATTR_R |= ((uint16_t)srdMask[2] << 8);
-
-    NVIC_MPU_NUMBER_R = SRAM[3].region_number; // Set to region
-    NVIC_MPU_ATTR_R &= 0xFFFF00FF;
-    NVIC_MPU_ATTR_R |= ((uint16_t)srdMask[3] << 8);
-
-    NVIC_MPU_NUMBER_R = SRAM[4].region_number; // Set to region
-    NVIC_MPU_ATTR_R &= 0xFFFF00FF;
-    NVIC_MPU_ATTR_R |= ((uint16_t)srdMask[4] << 8);
+    uint8_t i;
+
+    for(i = 0; i < NUM_SRAM_REGIONS; i++)
+    {
+        NVIC_MPU_NUMBER_R = SRAM[i].region_number; // Set to region
+        NVIC_MPU_ATTR_R = (NVIC_MPU_ATTR_R & 0xFFFF00FF) | ((uint32_t)srdMask[i] << 8);
+    }
+}
+
+// Builds the region base and attribute values for a window that unprivileged code can only read.
+// The MPU needs the buffer to be a power of two (at least 32 bytes) and aligned to its size
+bool generateReadOnlyWindow(uint32_t window[2], void *baseAdd, uint32_t size_in_bytes)
+{
+    uint8_t n = 5;
+
+    while(n < 32 && (1u << n) < size_in_bytes)
+        n++;
+
+    if(n == 32 || (1u << n) != size_in_bytes || ((uint32_t)baseAdd & (size_in_bytes - 1)))
+        return false;
+
+    window[0] = (uint32_t)baseAdd;
+    window[1] = ((uint32_t)(n - 1) << 1)                          // size = 2^(N+1)
+                | NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE // set according to table 3-6
+                | 0x02000000                                        // set AP to 010, RW for priv, RO for unpriv
+                | NVIC_MPU_ATTR_XN                                  // instructions are not executable
+                | NVIC_MPU_ATTR_ENABLE;
+    return true;
 }
 
+// Moves the read-only window region, an attribute value of 0 closes it
+void applyReadOnlyWindow(uint32_t window[2])
+{
+    NVIC_MPU_NUMBER_R = READ_ONLY_WINDOW_REGION;
+    NVIC_MPU_ATTR_R = 0; // disable while the base moves
+    NVIC_MPU_BASE_R = window[0];
+    NVIC_MPU_ATTR_R = window[1];
+}
 
 void allowFlashAccess(void)
 {
@@ -344,141 +511,30 @@ void allowPeripheralAccess(void)
     NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //enable region
 }
 
-void setupSramAccess(void)
+// Sets up one SRAM region with all subregions disabled, ap is the AP field (bits 26:24)
+void setupSramRegion(uint8_t region, uint32_t base, uint32_t size, uint32_t ap)
 {
+    NVIC_MPU_NUMBER_R = region;
+    NVIC_MPU_ATTR_R = 0;                                  // disable while the base moves
+    NVIC_MPU_BASE_R = base;                               // base must be aligned to the size
+    NVIC_MPU_ATTR_R = ((uint32_t)(30 - _norm(size)) << 1) // size = 2^(N+1)
+                    | NVIC_MPU_ATTR_SRD_M                 // disable all SRD
+                    | NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE // set according to table 3-6
+                    | ap
+                    | NVIC_MPU_ATTR_XN                    // instructions are not executable
+                    | NVIC_MPU_ATTR_ENABLE;
+}
 
-    // set up SRAM region (region 2 - 4K block) (KERNEL HEAP)
-    NVIC_MPU_NUMBER_R |= NVIC_MPU_NUMBER_M; // Set region to 7 (to avoid accidental change)
-    NVIC_MPU_NUMBER_R &= 0xFFFFFFFA; // Set to region 2
-    NVIC_MPU_BASE_R &= ~(0xFFFFF0008); // turn off valid bit and zero base reg
-    NVIC_MPU_BASE_R |= 0x20000000;     //sets base addr to 0x20000000 N = 12, bits (N-1):5 reserved
-                                      //, & zero valid bit to ensure correct region edited.
-                                      // 0x20000000 / 0x00001000 = 0x20000 = 0b0010.0000.0000.0000.0000
-    NVIC_MPU_ATTR_R &=  ~(NVIC_MPU_ATTR_SIZE_M); // clear size bits
-    NVIC_MPU_ATTR_R |= 0x0000000B << 1; // size = 2^(N+1) N = 11 2^12 = 4KiB = 0xB
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SRD_M; // enable all SRD
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_BUFFRABLE); // set according to table 3-6
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE;
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_TEX_M);  // in datasheet
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_AP_M); // set AP to 0 (clear)
-    NVIC_MPU_ATTR_R |= 0x01000000; // set AP to 001, RW for priv
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_XN; // instructions are not executable
-
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //enable region
-
-    // set up SRAM region (region 3 - 4K block)
-    NVIC_MPU_NUMBER_R |= NVIC_MPU_NUMBER_M; // Set region to 7 (to avoid accidental change)
-    NVIC_MPU_NUMBER_R &= 0xFFFFFFFB; // Set to region 3
-    NVIC_MPU_BASE_R &= ~(0xFFFFF0008); // turn off valid bit and zero base reg
-    NVIC_MPU_BASE_R |= 0x20001000;     //sets base addr to 0x20001000 N = 12, bits (N-1):5 reserved
-                                      //, & zero valid bit to ensure correct region edited.
-                                      // 0x20001000 / 0x00001000 = 0x20001 = 0b0010.0000.0000.0000.0001
-    NVIC_MPU_ATTR_R &=  ~(NVIC_MPU_ATTR_SIZE_M); // clear size bits
-    NVIC_MPU_ATTR_R |= 0x0000000B << 1; //size = 2^(N+1) N = 11 2^12 = 4KiB = 0xB
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SRD_M; // enable all SRD
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_BUFFRABLE); // set according to table 3-6
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE;
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_TEX_M);  // in datasheet
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_AP_M); // set AP to 0 (clear)
-    NVIC_MPU_ATTR_R |= 0x03000000; // set AP to 011, RW for unpriv and priv
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_XN; // instructions are not executable
-
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //enable region
-
-    SRAM[0].address = (uint32_t *) 0x20001000;
-    SRAM[0].region_number = 3;
-    SRAM[0].size = 4096;
-
-    // set up SRAM region (region 4 - 8K block)
-    NVIC_MPU_NUMBER_R |= NVIC_MPU_NUMBER_M; // Set region to 7 (to avoid accidental change)
-    NVIC_MPU_NUMBER_R &= 0xFFFFFFFC; // Set to region 4
-    NVIC_MPU_BASE_R &= ~(0xFFFFE0008); // turn off valid bit and zero base reg
-    NVIC_MPU_BASE_R |= 0x20002000;     //sets base addr to 0x20002000 N = 13, bits (N-1):5 reserved
-                                      //, & zero valid bit to ensure correct region edited.
-                                      // 0x20002000 / 0x00002000 = 0x10001 = 0b0010000000000000010
-    NVIC_MPU_ATTR_R &=  ~(NVIC_MPU_ATTR_SIZE_M); // clear size bits
-    NVIC_MPU_ATTR_R |= 0x0000000C << 1; //size = 2^(N+1) N = 12 2^13 = 8KiB = 0xC
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SRD_M; // enable all SRD
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_BUFFRABLE); // set according to table 3-6
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE;
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_TEX_M);  // in datasheet
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_AP_M); // set AP to 0 (clear)
-    NVIC_MPU_ATTR_R |= 0x03000000; // set AP to 011, RW for unpriv and priv
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_XN; // instructions are not executable
-
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //enable region
-
-    SRAM[1].address = (uint32_t *) 0x20002000;
-    SRAM[1].region_number = 4;
-    SRAM[1].size = 8192;
-
-    // set up SRAM region (region 5 - 4K block)
-    NVIC_MPU_NUMBER_R |= NVIC_MPU_NUMBER_M; // Set region to 7 (to avoid accidental change)
-    NVIC_MPU_NUMBER_R &= 0xFFFFFFFD; // Set to region 5
-    NVIC_MPU_BASE_R &= ~(0xFFFFF0008); // turn off valid bit and zero base reg
-    NVIC_MPU_BASE_R |= 0x20004000;     //sets base addr to 0x20004000 N = 12, bits (N-1):5 reserved
-                                      //, & zero valid bit to ensure correct region edited.
-                                      // 0x20004000 / 0x00001000 = 0x20004 = 0b0010.0000.0000.0000.0100
-    NVIC_MPU_ATTR_R &=  ~(NVIC_MPU_ATTR_SIZE_M); // clear size bits
-    NVIC_MPU_ATTR_R |= 0x0000000B << 1; //size = 2^(N+1) N = 11 2^12 = 4KiB = 0xB
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SRD_M; // enable all SRD
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_BUFFRABLE); // set according to table 3-6
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE;
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_TEX_M);  // in datasheet
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_AP_M); // set AP to 0 (clear)
-    NVIC_MPU_ATTR_R |= 0x03000000; // set AP to 011, RW for unpriv and priv
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_XN; // instructions are not executable
-
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //enable region
-
-    SRAM[2].address = (uint32_t *) 0x20004000;
-    SRAM[2].region_number = 5;
-    SRAM[2].size = 4096;
-
-    // set up SRAM region (region 6 - 4K block)
-    NVIC_MPU_NUMBER_R |= NVIC_MPU_NUMBER_M; // Set region to 7 (to avoid accidental change)
-    NVIC_MPU_NUMBER_R &= 0xFFFFFFFE; // Set to region 6
-    NVIC_MPU_BASE_R &= ~(0xFFFFF0008); // turn off valid bit and zero base reg
-    NVIC_MPU_BASE_R |= 0x20005000;     //sets base addr to 0x20005000 N = 12, bits (N-1):5 reserved
-                                      //, & zero valid bit to ensure correct region edited.
-                                      // 0x20005000 / 0x00001000 = 0x20005 = 0b0010.0000.0000.0000.0101
-    NVIC_MPU_ATTR_R &=  ~(NVIC_MPU_ATTR_SIZE_M); // clear size bits
-    NVIC_MPU_ATTR_R |= 0x0000000B << 1; //size = 2^(N+1) N = 11 2^12 = 4KiB = 0xB
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SRD_M; // enable all SRD
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_BUFFRABLE); // set according to table 3-6
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE;
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_TEX_M);  // in datasheet
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_AP_M); // set AP to 0 (clear)
-    NVIC_MPU_ATTR_R |= 0x03000000; // set AP to 011, RW for unpriv and priv
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_XN; // instructions are not executable
-
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //enable region
-
-    SRAM[3].address = (uint32_t *) 0x20005000;
-    SRAM[3].region_number = 6;
-    SRAM[3].size = 4096;
-
-    // set up SRAM region (region 7 - 8K block)
-    NVIC_MPU_NUMBER_R |= NVIC_MPU_NUMBER_M; // Set region to 7
-    NVIC_MPU_BASE_R &= ~(0xFFFFE0008); // turn off valid bit and zero base reg
-    NVIC_MPU_BASE_R |= 0x20006000;     //sets base addr to 0x20006000 N = 13, bits (N-1):5 reserved
-                                      //, & zero valid bit to ensure correct region edited.
-                                      // 0x20006000 / 0x00002000 = 0x10003 = 0b0001000000000000110
-    NVIC_MPU_ATTR_R &=  ~(NVIC_MPU_ATTR_SIZE_M); // clear size bits
-    NVIC_MPU_ATTR_R |= 0x0000000C << 1; //size = 2^(N+1) N = 12 2^13 = 8KiB = 0xC
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SRD_M; // enable all SRD
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_BUFFRABLE); // set according to table 3-6
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE;
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_TEX_M);  // in datasheet
-    NVIC_MPU_ATTR_R &= ~(NVIC_MPU_ATTR_AP_M); // set AP to 0 (clear)
-    NVIC_MPU_ATTR_R |= 0x03000000; // set AP to 011, RW for unpriv and priv
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_XN; // instructions are not executable
+// Sets up kernel SRAM (RW for priv) and the task regions (RW for unpriv and priv) from the layout in mm.h
+void setupSramAccess(void)
+{
+    uint8_t i;
 
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //enable region
+    // after the first task switch the kernel region becomes the read-only window (see applyReadOnlyWindow)
+    setupSramRegion(KERNEL_SRAM_REGION, SRAM_BASE, KERNEL_SRAM_BYTES, 0x01000000);
 
-    SRAM[4].address = (uint32_t *) 0x20006000;
-    SRAM[4].region_number = 7;
-    SRAM[4].size = 8192;
+    for(i = 0; i < NUM_SRAM_REGIONS; i++)
+        setupSramRegion(SRAM[i].region_number, SRAM[i].address, SRAM[i].size, 0x03000000);
 }
 
 bool verifyAccess(uint8_t srdMaskRequired[NUM_SRAM_REGIONS], uint8_t srdMaskActive[NUM_SRAM_REGIONS])
@@ -500,42 +556,75 @@ bool verifyAccess(uint8_t srdMaskRequired[NUM_SRAM_REGIONS], uint8_t srdMaskActi
     return ok;
 }
 
-// REQUIRED: initialize MPU here
-void initMpu(void)
+// Builds the unit to subregion table, marks the units in HEAP_UNIT subregions, and frees the heap
+// as the largest aligned blocks that fit
+void initHeap(void)
 {
-    // REQUIRED: call your MPU functions here
+    uint32_t unit;
+    uint8_t i;
+    uint8_t k;
 
-    // -1 rule to ensure no issues (no background)
-    NVIC_MPU_CTRL_R |= NVIC_MPU_CTRL_PRIVDEFEN;
+    for(unit = 0; unit < HEAP_UNITS; unit++)
+    {
+        unitRegion[unit] = NUM_SRAM_REGIONS;
+        unitSubregion[unit] = 0;
+    }
 
-    // Initialize heap
-    uint8_t i;
-    uint32_t temp_address = 0x20008000;
-    for(i = 0; i < NUM_BLOCKS; i++)
+    for(i = 0; i < NUM_SRAM_REGIONS; i++)
     {
-        if(i < 7 || (i > 22 && i < 29))
+        if(SRAM[i].size / 8 > largestSubregion)
+            largestSubregion = SRAM[i].size / 8;
+
+        for(unit = (SRAM[i].address - SRAM_BASE) / HEAP_UNIT; unit < (SRAM[i].address - SRAM_BASE + SRAM[i].size) / HEAP_UNIT; unit++)
         {
-            heap[i].size = 1024;
+            unitRegion[unit] = i;
+            unitSubregion[unit] = 1 << ((SRAM_BASE + unit * HEAP_UNIT - SRAM[i].address) / (SRAM[i].size / 8));
         }
-        else if(i == 7 || i == 22 || i == 29)
+
+        if(SRAM[i].size / 8 == HEAP_UNIT)
         {
-            heap[i].size = 1536;
+            for(unit = (SRAM[i].address - SRAM_BASE) / HEAP_UNIT; unit < (SRAM[i].address - SRAM_BASE + SRAM[i].size) / HEAP_UNIT; unit++)
+                fineMap[0] |= (uint64_t)1 << unit;
         }
-        else
+    }
+    for(k = 1; k < BUDDY_ORDERS; k++)
+    {
+        for(i = 0; i < (HEAP_UNITS >> k); i++)
         {
-            heap[i].size = 512;
+            if(fineMap[k - 1] & ((uint64_t)3 << (2 * i)))
+                fineMap[k] |= (uint64_t)1 << i;
         }
+    }
 
-        temp_address -= heap[i].size; //to get to base of block
-        heap[i].address = (void*) temp_address;
-        heap[i].free = true;
+    unit = (HEAP_BASE - SRAM_BASE) / HEAP_UNIT;
+    while(unit < HEAP_UNITS)
+    {
+        k = BUDDY_ORDERS - 1;
+        while((unit & ((1 << k) - 1)) != 0 || unit + (1 << k) > HEAP_UNITS)
+            k--;
+
+        freeMap[k] |= (uint64_t)1 << (unit >> k);
+        unit += 1 << k;
     }
+    freeBytes = HEAP_TOP - HEAP_BASE;
+}
+
+// REQUIRED: initialize MPU here
+void initMpu(void)
+{
+    // REQUIRED: call your MPU functions here
+
+    // -1 rule to ensure no issues (no background)
+    NVIC_MPU_CTRL_R |= NVIC_MPU_CTRL_PRIVDEFEN;
 
     // Set region permissions
     allowFlashAccess();
     allowPeripheralAccess();
     setupSramAccess();
 
+    // Initialize heap
+    initHeap();
+
     // Init Interrupts
     NVIC_SYS_HND_CTRL_R |= NVIC_SYS_HND_CTRL_USAGE;
     NVIC_SYS_HND_CTRL_R |= NVIC_SYS_HND_CTRL_BUS;
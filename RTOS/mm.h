@@ -11,18 +11,67 @@
 #ifndef MM_H_
 #define MM_H_
 
-#define NUM_SRAM_REGIONS 5
-
+#include <stdint.h>
 #include <stdbool.h>
+#include "kernel.h"
+
+// SRAM layout, everything the MPU setup, heap and srd masks are built from.
+// Kernel SRAM comes first (privileged only, must match the SRAM length in the linker command file),
+// then the task regions, which hold the log ring and the heap. Each region is a power of 2 aligned to
+// its size, and is split into 8 subregions that are each a multiple of HEAP_UNIT. The heap bitmaps hold
+// 64 units, and HEAP_ORDERS (kernel.h) must be log2 of the heap units + 1. The checks below and the
+// region checks in mm.c stop the build when an edit breaks any of this
+#define FLASH_TOP          0x00040000 // flash (from 0) is readable by every task
+#define SRAM_BASE          0x20000000
+#define SRAM_TOP           0x20008000
+#define KERNEL_SRAM_BYTES  0x1000
+#define KERNEL_SRAM_REGION 2 // also the read-only window once tasks run
+#define LOG_BASE           (SRAM_BASE + KERNEL_SRAM_BYTES) // binary log ring (log.h), kept out of the heap
+#define LOG_BYTES          512                             // and writable by every task, one HEAP_UNIT subregion
+#define HEAP_UNIT          512
+#define NUM_SRAM_REGIONS   5
+
+// REGION(base, size, MPU region) for each task region, in address order
+#define SRAM_REGIONS(REGION) REGION(0x20001000, 4096, 3) \
+                             REGION(0x20002000, 8192, 4) \
+                             REGION(0x20004000, 4096, 5) \
+                             REGION(0x20005000, 4096, 6) \
+                             REGION(0x20006000, 8192, 7)
+
+#if (SRAM_TOP - SRAM_BASE) % HEAP_UNIT != 0 || (SRAM_TOP - SRAM_BASE) / HEAP_UNIT > 64
+#error "SRAM_BASE to SRAM_TOP must be at most 64 HEAP_UNITs"
+#endif
+#if (1 << (HEAP_ORDERS - 1)) != (SRAM_TOP - SRAM_BASE) / HEAP_UNIT
+#error "HEAP_ORDERS must be log2 of the heap units + 1"
+#endif
+#if (KERNEL_SRAM_BYTES & (KERNEL_SRAM_BYTES - 1)) != 0 || SRAM_BASE % KERNEL_SRAM_BYTES != 0 || \
+    KERNEL_SRAM_BYTES % (8 * HEAP_UNIT) != 0
+#error "kernel SRAM must be a power of 2 aligned to its size, in subregions a multiple of HEAP_UNIT"
+#endif
+#if LOG_BYTES != HEAP_UNIT
+#error "the log ring must be one HEAP_UNIT"
+#endif
+
+#define READ_ONLY_WINDOW_REGION KERNEL_SRAM_REGION // MPU region moved on each switch to expose a read-only shared buffer
 
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 void * mallocFromHeap(uint32_t size_in_bytes);
+void * mallocGuardedFromHeap(uint32_t size_in_bytes, uint32_t *guardBytes);
+bool freeToHeap(void *ptr);
+uint32_t getFreeHeap(void);
+void getHeapStats(HEAP_INFO *info);
+bool getHeapBlock(uint8_t n, HEAP_BLOCK *block);
+uint32_t generateHeapSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS], void *ptr);
+uint32_t getSubregionSize(void *address);
+bool measureHeapLatency(HEAP_LATENCY *latency, bool restart);
 void initMpu(void);
 void generateSramSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS], void *baseAdd, uint32_t size_in_bytes);
 void applySramSrdMasks(uint8_t srdMask[NUM_SRAM_REGIONS]);
+bool generateReadOnlyWindow(uint32_t window[2], void *baseAdd, uint32_t size_in_bytes);
+void applyReadOnlyWindow(uint32_t window[2]);
 bool verifyAccess(uint8_t srdMaskRequired[NUM_SRAM_REGIONS], uint8_t srdMaskActive[NUM_SRAM_REGIONS]);
 
 #endif
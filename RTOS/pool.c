@@ -0,0 +1,149 @@
+// Task memory functions (object pools and private heaps)
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Pools and task heaps run entirely in the calling task (no SVC), so their memory must be memory the task
+// can already access. Each belongs to one task, or must be guarded by the task with a mutex
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pool.h"
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Splits a word aligned buffer of POOL_BUFFER_BYTES(objectSize, count) into count free objects
+bool initPool(POOL* pool, void* buffer, uint16_t objectSize, uint16_t count)
+{
+    uint16_t i;
+
+    if(buffer == 0 || count == 0 || ((uint32_t)buffer & 3))
+        return false;
+
+    pool->base = buffer;
+    pool->objectSize = POOL_OBJECT_BYTES(objectSize);
+    pool->count = count;
+    pool->used = 0;
+
+    // Link the objects in address order, the last one ends the list
+    for(i = 0; i < count - 1; i++)
+        *(void **)(pool->base + i * pool->objectSize) = pool->base + (i + 1) * pool->objectSize;
+    *(void **)(pool->base + i * pool->objectSize) = 0;
+
+    pool->free = pool->base;
+    return true;
+}
+
+// Takes the first object off the free list, returns 0 when the pool is empty
+void* poolAlloc(POOL* pool)
+{
+    void* object = pool->free;
+
+    if(object != 0)
+    {
+        pool->free = *(void **)object;
+        pool->used++;
+    }
+    return object;
+}
+
+// Puts an object back on the free list, fails if it is not one of the pool's objects
+bool poolFree(POOL* pool, void* object)
+{
+    uint32_t offset = (uint8_t *)object - pool->base;
+
+    if((uint8_t *)object < pool->base || offset >= (uint32_t)pool->objectSize * pool->count
+       || offset % pool->objectSize != 0 || pool->used == 0)
+        return false;
+
+    *(void **)object = pool->free;
+    pool->free = object;
+    pool->used--;
+    return true;
+}
+
+// Makes the bytes after the header one free block (called by the kernel when the task is created or restarted),
+// a heap smaller than TASK_HEAP_MIN_BYTES is left empty
+void initTaskHeap(TASK_HEAP* heap, uint32_t bytes)
+{
+    heap->used = 0;
+    if(bytes < TASK_HEAP_MIN_BYTES)
+    {
+        heap->size = 0;
+        return;
+    }
+    heap->size = (bytes - sizeof(TASK_HEAP)) & ~3;
+    *(uint32_t *)(heap + 1) = heap->size;
+}
+
+// First fit over the heap's blocks, merging runs of free blocks on the way, returns 0 when nothing fits
+void* taskMalloc(TASK_HEAP* heap, uint32_t size)
+{
+    uint32_t* block = (uint32_t *)(heap + 1);
+    uint32_t* end = (uint32_t *)((uint8_t *)block + heap->size);
+    uint32_t* next;
+    uint32_t bytes;
+
+    // sizes near 4 GB would wrap to 0 when rounded, and nothing larger than the heap can fit anyway
+    if(size == 0 || size > heap->size)
+        return 0;
+
+    bytes = (size + sizeof(uint32_t) + 3) & ~3;
+    if(bytes > heap->size - heap->used)
+        return 0;
+
+    for(; block < end; block = (uint32_t *)((uint8_t *)block + (*block & ~TASK_HEAP_USED)))
+    {
+        if(*block & TASK_HEAP_USED)
+            continue;
+
+        next = (uint32_t *)((uint8_t *)block + *block);
+        while(next < end && !(*next & TASK_HEAP_USED))
+        {
+            *block += *next;
+            next = (uint32_t *)((uint8_t *)block + *block);
+        }
+
+        if(*block >= bytes)
+        {
+            // Split off the rest if it can hold a header and a word
+            if(*block - bytes >= 2 * sizeof(uint32_t))
+            {
+                *(uint32_t *)((uint8_t *)block + bytes) = *block - bytes;
+                *block = bytes;
+            }
+
+            heap->used += *block;
+            *block |= TASK_HEAP_USED;
+            return block + 1;
+        }
+    }
+
+    return 0;
+}
+
+// Marks a block from taskMalloc free (merged with its free neighbours by the next taskMalloc),
+// fails if ptr is outside the heap or not in use
+bool taskFree(TASK_HEAP* heap, void* ptr)
+{
+    uint32_t* block = (uint32_t *)ptr - 1;
+
+    if(block < (uint32_t *)(heap + 1) || (uint8_t *)ptr >= (uint8_t *)(heap + 1) + heap->size
+       || ((uint32_t)ptr & 3) || !(*block & TASK_HEAP_USED))
+        return false;
+
+    *block &= ~TASK_HEAP_USED;
+    heap->used -= *block;
+    return true;
+}
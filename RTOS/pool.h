@@ -0,0 +1,58 @@
+// Task memory functions (object pools and private heaps)
+// Carson Fabbro
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// objects are word aligned and hold the free list link while free
+#define POOL_OBJECT_BYTES(size) ((((size) < 4 ? 4 : (size)) + 3) & ~3)
+
+// bytes of buffer needed for count objects of size bytes, e.g. uint32_t buf[POOL_BUFFER_BYTES(12, 8) / 4]
+#define POOL_BUFFER_BYTES(size, count) (POOL_OBJECT_BYTES(size) * (count))
+
+// fixed-size objects carved from a buffer the task owns (its stack, or shared memory it may write)
+typedef struct _POOL
+{
+    void* free;          // first free object, each free object holds the next
+    uint8_t* base;
+    uint16_t objectSize;
+    uint16_t count;
+    uint16_t used;
+} POOL;
+
+// private heap placed above a task's stack by createThread, found once with getTaskHeap()
+typedef struct _TASK_HEAP
+{
+    uint32_t size;       // bytes of blocks after this header
+    uint32_t used;       // bytes in allocated blocks, block headers included
+} TASK_HEAP;
+
+// each heap block starts with a word holding its size in bytes (headers included) and a used bit
+#define TASK_HEAP_USED 1
+
+// smallest private heap, its header and one block
+#define TASK_HEAP_MIN_BYTES (sizeof(TASK_HEAP) + 8)
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool initPool(POOL* pool, void* buffer, uint16_t objectSize, uint16_t count);
+void* poolAlloc(POOL* pool);
+bool poolFree(POOL* pool, void* object);
+
+void initTaskHeap(TASK_HEAP* heap, uint32_t bytes);
+void* taskMalloc(TASK_HEAP* heap, uint32_t size);
+bool taskFree(TASK_HEAP* heap, void* ptr);
+
+#endif
@@ -38,6 +38,8 @@
 #include "faults.h"
 #include "tasks.h"
 #include "shell.h"
+#include "bench.h"
+#include "log.h"
 
 //-----------------------------------------------------------------------------
 // Main
@@ -51,34 +53,46 @@ int main(void)
     initSystemClockTo40Mhz();
     initHw();
     initUart0();
+    initBenchTimer();
     initMpu();
+    initLog();
     initRtos();
 
     // Setup UART0 baud rate
     setUart0BaudRate(115200, 40e6);
 
     // Initialize mutexes and semaphores
-    initMutex(resource, "resource");
-    initSemaphore(keyPressed, 1, "keyPressed");
-    initSemaphore(keyReleased, 0, "keyReleased");
-    initSemaphore(flashReq, 5, "flashReq");
+    // (tasks look these up by name with getHandle)
+    initMutex("resource");
+    initSemaphore(1, "keyPressed");
+    initSemaphore(0, "keyReleased");
+    initSemaphore(5, "flashReq");
+
+    // Software timers, run by the timer daemon
+    setTimer(initTimer(flash4Hz, 0, "flash4Hz"), 125, true);
+
+    // Console input arrives a line at a time through a pipe filled by the UART0 receive interrupt,
+    // task output leaves through one the transmit interrupt empties
+    setUart0RxPipe(initPipe(256, CONSOLE_PIPE));
+    setUart0TxPipe(initPipe(512, CONSOLE_TX_PIPE));
 
     // Add required idle process at lowest priority
-    ok =  createThread(idle, "Idle", 7, 512);
+    ok =  createThread(idle, "Idle", 7, 512, 0);
 
     // For step 8
-    //ok =  createThread(idle2, "Idle2", 7, 512);
+    //ok =  createThread(idle2, "Idle2", 7, 512, 0);
 
     // Add other processes
-    ok &= createThread(lengthyFn, "LengthyFn", 6, 1024);
-    ok &= createThread(flash4Hz, "Flash4Hz", 4, 1024);
-    ok &= createThread(oneshot, "OneShot", 2, 1024);
-    ok &= createThread(readKeys, "ReadKeys", 6, 1024);
-    ok &= createThread(debounce, "Debounce", 6, 1024);
-    ok &= createThread(important, "Important", 0, 1024);
-    ok &= createThread(uncooperative, "Uncoop", 6, 1024);
-    ok &= createThread(errant, "Errant", 6, 1024);
-    ok &= createThread(shell, "Shell", 6, 4096);
+    ok &= createThread(lengthyFn, "LengthyFn", 6, 1024, 0);
+    ok &= createThread(timerDaemon, "TimerDaemon", 1, 512, 0);
+    ok &= createThread(oneshot, "OneShot", 2, 1024, 0);
+    ok &= createThread(readKeys, "ReadKeys", 6, 1024, 0);
+    ok &= createThread(debounce, "Debounce", 6, 1024, 0);
+    ok &= createThread(important, "Important", 0, 1024, 0);
+    ok &= createThread(uncooperative, "Uncoop", 6, 1024, 0);
+    ok &= createThread(errant, "Errant", 6, 1024, 0);
+    ok &= createThread(shell, "Shell", 6, 3072, 0); // with its stack guard this still fits a 4K block
+    ok &= createThread(logDrain, "LogDrain", 7, 512, 0);
 
     // Start up RTOS
     if (ok)
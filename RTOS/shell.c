@@ -23,13 +23,14 @@
 #include "asm.h"
 #include "string.h"
 #include "kernel.h"
+#include "bench.h"
+#include "kprintf.h"
 
 // REQUIRED: Add header files here for your strings functions, ...
 
 // Data Restrictions and Struct
 #define MAX_CHARS 80
 #define MAX_FIELDS 6
-#define BUF_SIZE 32
 
 typedef struct _USER_DATA
 {
@@ -44,44 +45,10 @@ typedef struct _USER_DATA
 // Subroutines
 //-----------------------------------------------------------------------------
 
-// Get String From Uart Function
+// Get String From Uart Function (echo and backspace are handled while the line is typed, see getlUart0)
 void getsUart0(USER_DATA* data)
 {
-    uint16_t count = 0;
-    char c;
-
-    while(true)
-    {
-        // Get character from uart
-        c = getcUart0();
-
-        // If character is backspace, and string is not empty (count > 0), delete character (count --)
-        if((c == 8 || c == 127) && count > 0)
-        {
-            count--;
-        }
-
-        // If character is line feed or carriage return, add null terminator & return
-        else if(c == 10 || c == 13)
-        {
-            data->buffer[count] = '\0';
-            return;
-        }
-
-        // If character is a space or printable, then store it in data, and increment count. If count then equals maxChars,
-        // add null and return
-        else if(c >= 32)
-        {
-            data->buffer[count] = c;
-            count++;
-
-            if(count == MAX_CHARS)
-            {
-                data->buffer[count] = '\0';
-                return;
-            }
-        }
-    }
+    getlUart0(data->buffer, MAX_CHARS + 1);
 }
 
 // Parse the fields in the buffer
@@ -190,8 +157,6 @@ bool isCommand(USER_DATA* data, const char strCommand[], uint8_t minArguments)
 void clearFields(USER_DATA* data)
 {
     uint8_t i;
-    // Clear buffer of \n so next input can be read
-    getcUart0();
 
     // Clear all fields in data
     for(i = 0; i < MAX_CHARS; i++)
@@ -206,198 +171,274 @@ void clearFields(USER_DATA* data)
     data->fieldCount = 0;
 }
 
-void ps()
+// Names a task state for ps (sleeping tasks are shown with their ticks instead)
+const char* getStateName(uint8_t state)
+{
+    switch(state)
+    {
+        case STATE_BLOCKED_MUTEX:     return "Blocked by Mutex / RW Lock";
+        case STATE_BLOCKED_SEMAPHORE: return "Blocked by Semaphore";
+        case STATE_BLOCKED_CONDITION: return "Waiting on Condition";
+        case STATE_BLOCKED_EVENT:     return "Waiting on Event";
+        case STATE_BLOCKED_NOTIFY:    return "Waiting on Notification";
+        case STATE_BLOCKED_PIPE:      return "Waiting on Pipe";
+        case STATE_BLOCKED_TIMER:     return "Waiting on Timers";
+        case STATE_BLOCKED_BARRIER:   return "Waiting at Barrier";
+        case STATE_UNRUN:             return "Unrun";
+        case STATE_READY:             return "Ready";
+        case STATE_STOPPED:           return "Stopped";
+        default:                      return "";
+    }
+}
+
+void ps(void)
 {
 
     TASK_INFO taskTable;
     uint8_t i;
     uint8_t ok;
-    char str[BUF_SIZE] = {0};
 
-    putsUart0("--------------- TASKS ---------------\n");
+    kprintf("--------------- TASKS ---------------\n");
     for(i = 0; i < MAX_TASKS; i++)
     {
         ok = getTaskInfo((void *)&taskTable, i);
         if(ok == 0)
         {
-            putsUart0("ERROR: Attempting to access illegal memory address\n");
+            kprintf("ERROR: Attempting to access illegal memory address\n");
         }
 
         if(taskTable.state != STATE_INVALID)
         {
-            putsUart0(taskTable.name);
-            putsUart0("\n\t");
-
-            putsUart0("Pid: ");
-            putsUart0(itoa(taskTable.pid, str));
-            putsUart0("\n\t");
-
-            putsUart0("State: ");
+            kprintf("%s\n\tPid: %u\n\tState: ", taskTable.name, taskTable.pid);
             if(taskTable.state == STATE_DELAYED)
-            {
-                putsUart0("Sleep for ");
-                putsUart0(itoa(taskTable.ticks, str));
-                putsUart0(" ms\n\t");
-            }
-            else if(taskTable.state == STATE_BLOCKED_MUTEX)
-            {
-                putsUart0("Blocked by Mutex");
-                putsUart0("\n\t");
-            }
-            else if(taskTable.state == STATE_BLOCKED_SEMAPHORE)
-            {
-                putsUart0("Blocked by Semaphore");
-                putsUart0("\n\t");
-            }
-            else if(taskTable.state == STATE_UNRUN)
-            {
-                putsUart0("Unrun");
-                putsUart0("\n\t");
-            }
-            else if(taskTable.state == STATE_READY)
-            {
-                putsUart0("Ready");
-                putsUart0("\n\t");
-            }
-            else if(taskTable.state == STATE_STOPPED)
-            {
-                putsUart0("Stopped");
-                putsUart0("\n\t");
-            }
+                kprintf("Sleep for %u ms\n\t", taskTable.ticks);
+            else
+                kprintf("%s\n\t", getStateName(taskTable.state));
 
-            putsUart0("CPU Usage: ");
-            putsUart0(taskTable.cpuUsage);
-            putsUart0("%\n");
+            kprintf("Stack: %u/%u bytes\n\t", taskTable.stackUsed, taskTable.stackBytes);
+            if(taskTable.heapBytes != 0)
+                kprintf("Heap: %u/%u bytes\n\t", taskTable.heapUsed, taskTable.heapBytes);
+            kprintf("CPU Usage: %.2u%%\n", taskTable.cpuUsage);
          }
     }
 
     getTaskInfo((void *)&taskTable, i);
 
     //Kernel
-    putsUart0("Kernel");
-    putsUart0("\n\t");
+    kprintf("Kernel\n\tPid: -\n\tState: -\n\tCPU Usage: %.2u%%\n", taskTable.cpuUsage);
+}
 
-    putsUart0("Pid: ");
-    putcUart0('-');
-    putsUart0("\n\t");
 
-    putsUart0("State: ");
-    putcUart0('-');
-    putsUart0("\n\t");
+void printWaiters(char waiters[][16], uint8_t numWaiters)
+{
+    uint8_t j;
 
-    putsUart0("CPU Usage: ");
-    putsUart0(taskTable.cpuUsage);
-    putsUart0("%\n");
-}
+    if(numWaiters > 0)
+    {
+        kprintf("Wait List:");
 
+        for(j = 0; j < numWaiters; j++)
+            kprintf("\n\t\t%s", waiters[j]);
+    }
+    else
+    {
+        kprintf("No wait list");
+    }
+}
 
-void ipcs()
+// Lists all kernel objects, or only the one with the given name
+void ipcs(const char name[])
 {
-    MUTEX_INFO mutexTable;
-    SEMAPHORE_INFO semaphoreTable;
+    OBJECT_INFO objectInfo;
     uint8_t i;
-    char str[BUF_SIZE] = {0};
+    uint8_t j;
+    uint8_t first = 0;
+    uint8_t last = MAX_KERNEL_OBJECTS - 1;
     uint8_t ok;
 
-    putsUart0("--------------- MUTEXES ---------------\n");
+    if(name != NULL)
+    {
+        uint32_t handle = getHandle(name);
+        if(handle == INVALID_HANDLE)
+        {
+            kprintf("%s does not exist...\n", name);
+            return;
+        }
+        first = last = handle & 0xFF;
+    }
+
+    kprintf("--------------- KERNEL OBJECTS ---------------\n");
 
-    for(i = 0; i < MAX_MUTEXES; i++)
+    for(i = first; i <= last; i++)
     {
-        ok = getMutexInfo((void *)&mutexTable, i);
+        ok = getObjectInfo((void *)&objectInfo, i);
         if(ok == 0)
         {
-            putsUart0("ERROR: Attempting to access illegal memory address\n");
+            kprintf("ERROR: Attempting to access illegal memory address\n");
+            return;
         }
 
-        putsUart0(mutexTable.name);
-        putsUart0(" [");
-        putsUart0(itoa(i, str));
-        putsUart0("]\n\t");
+        if(objectInfo.type == OBJECT_FREE)
+            continue;
 
-        if(mutexTable.lock)
-        {
-            putsUart0("Locked By: ");
-            putsUart0(mutexTable.lockedBy);
-            putsUart0("\n\t");
+        kprintf("%s [0x%08X]\n\t", objectInfo.name, objectInfo.handle);
 
-            if(mutexTable.numWaiters > 0)
+        if(objectInfo.type == OBJECT_MUTEX)
+        {
+            kprintf(objectInfo.info.mutex.recursive ? "Recursive Mutex\n\t" : "Mutex\n\t");
+            if(objectInfo.info.mutex.lock)
             {
-                uint8_t j;
-
-                putsUart0("Wait List:");
+                kprintf("Locked By: %s", objectInfo.info.mutex.lockedBy);
+                if(objectInfo.info.mutex.recursive)
+                    kprintf(" (depth %u)", objectInfo.info.mutex.depth);
+                kprintf("\n\t");
 
-                for(j = 0; j < mutexTable.numWaiters; j++)
-                {
-                    putsUart0("\n\t\t");
-                    putsUart0(mutexTable.waiters[j]);
-                }
+                printWaiters(objectInfo.info.mutex.waiters, objectInfo.info.mutex.numWaiters);
             }
             else
             {
-                putsUart0("No wait list");
+                kprintf("Unlocked");
             }
         }
-        else
+        else if(objectInfo.type == OBJECT_SEMAPHORE)
         {
-            putsUart0("Unlocked");
+            kprintf("Semaphore\n\tCount: %u\n\t", objectInfo.info.semaphore.count);
+
+            printWaiters(objectInfo.info.semaphore.waiters, objectInfo.info.semaphore.numWaiters);
         }
-        putcUart0('\n');
+        else if(objectInfo.type == OBJECT_RWLOCK)
+        {
+            kprintf("RW Lock\n\t");
+            if(objectInfo.info.rwlock.write)
+                kprintf("Write Locked By: %s", objectInfo.info.rwlock.writer);
+            else
+                kprintf("Readers: %u", objectInfo.info.rwlock.readers);
+            kprintf("\n\tWaiting Readers: %u\n\t", objectInfo.info.rwlock.numWaitingReaders);
 
-    }
+            printWaiters(objectInfo.info.rwlock.waitingWriters, objectInfo.info.rwlock.numWaitingWriters);
+        }
+        else if(objectInfo.type == OBJECT_CONDITION)
+        {
+            kprintf("Condition\n\t");
+            printWaiters(objectInfo.info.condition.waiters, objectInfo.info.condition.numWaiters);
+        }
+        else if(objectInfo.type == OBJECT_EVENT)
+        {
+            kprintf("Event Flags\n\tFlags: 0x%08X\n\t", objectInfo.info.event.flags);
 
-    putsUart0("--------------- SEMAPHORES ---------------\n");
+            printWaiters(objectInfo.info.event.waiters, objectInfo.info.event.numWaiters);
+        }
+        else if(objectInfo.type == OBJECT_TIMER)
+        {
+            kprintf("%s\n\tInterval: %u ms\n\t", objectInfo.info.timer.periodic ? "Periodic Timer" : "One-shot Timer",
+                    objectInfo.info.timer.interval);
+            if(objectInfo.info.timer.active)
+                kprintf("Expires in: %u ms", objectInfo.info.timer.remaining);
+            else
+                kprintf("Stopped");
+            if(objectInfo.info.timer.overruns > 0)
+                kprintf("\n\tOverruns: %u", objectInfo.info.timer.overruns);
+        }
+        else if(objectInfo.type == OBJECT_BARRIER)
+        {
+            kprintf("Barrier\n\tArrived: %u/%u  Phase: %u\n\t", objectInfo.info.barrier.arrived,
+                    objectInfo.info.barrier.count, objectInfo.info.barrier.phase);
 
-    for(i = 0; i < MAX_SEMAPHORES; i++)
-    {
-        getSemaphoreInfo((void *)&semaphoreTable, i);
-        if(ok == 0)
+            printWaiters(objectInfo.info.barrier.waiters, objectInfo.info.barrier.numWaiters);
+        }
+        else if(objectInfo.type == OBJECT_PIPE)
         {
-            putsUart0("ERROR: Attempting to access illegal memory address\n");
+            kprintf("Pipe\n\tBytes: %u/%u\n\tReaders ", objectInfo.info.pipe.count, objectInfo.info.pipe.size);
+            printWaiters(objectInfo.info.pipe.readers, objectInfo.info.pipe.numReaders);
+            kprintf("\n\tWriters ");
+            printWaiters(objectInfo.info.pipe.writers, objectInfo.info.pipe.numWriters);
         }
+        else if(objectInfo.type == OBJECT_SHARED)
+        {
+            kprintf("Shared Memory\n\tBase: 0x%08X  Size: %u\n\tOwner: %s\n\tAccess:", objectInfo.info.shared.base,
+                    objectInfo.info.shared.size, objectInfo.info.shared.owner);
 
-        putsUart0(semaphoreTable.name);
-        putsUart0(" [");
-        putsUart0(itoa(i, str));
-        putsUart0("]\n\t");
+            for(j = 0; j < objectInfo.info.shared.numTasks; j++)
+                kprintf("\n\t\t%s%s", objectInfo.info.shared.tasks[j],
+                        objectInfo.info.shared.access[j] == SHARED_READ_WRITE ? " (rw)" : " (ro)");
+        }
+        kprintf("\n");
+    }
+}
 
-        putsUart0("Count: ");
-        putsUart0(itoa(semaphoreTable.count, str));
-        putsUart0("\n\t");
+// Prints heap usage, the largest free block and the allocation counters on one line
+void memSummary(HEAP_INFO* info)
+{
+    kprintf("Free %u/%u bytes, largest block %u, allocs %u frees %u failed %u\n", info->freeBytes, info->size,
+            info->largestFree, info->allocations, info->frees, info->failures);
+}
 
-        if(semaphoreTable.numWaiters > 0)
-        {
-            uint8_t j;
+// Prints heap usage, free blocks by size, and every block in address order with its owner
+void mem()
+{
+    HEAP_INFO info;
+    HEAP_BLOCK block;
+    uint8_t i;
 
-            putsUart0("Wait List:");
+    kprintf("--------------- HEAP ---------------\n");
+    if(!getHeapInfo(&info))
+    {
+        kprintf("ERROR: Attempting to access illegal memory address\n");
+        return;
+    }
+    memSummary(&info);
 
-            for(j = 0; j < semaphoreTable.numWaiters; j++)
-            {
-                putsUart0("\n\t\t");
-                putsUart0(semaphoreTable.waiters[j]);
-            }
-        }
-        else
-        {
-            putsUart0("No wait list");
-        }
+    kprintf("Free blocks by size:");
+    for(i = 0; i < HEAP_ORDERS; i++)
+        kprintf(" %u:%u", info.unit << i, info.freeBlocks[i]);
+    kprintf("\n\n");
+
+    for(i = 0; getHeapBlockInfo(&block, i); i++)
+        kprintf("0x%08X\t%u\t%s\n", block.base, block.size, block.owner);
+}
+
+// Prints the heap summary once a second, other tasks keep running in between
+void memWatch(uint32_t seconds)
+{
+    HEAP_INFO info;
 
-        putcUart0('\n');
+    while(seconds-- > 0 && getHeapInfo(&info))
+    {
+        memSummary(&info);
+        sleep(1000);
     }
 }
 
+// Packs the stacks of stopped and unrun tasks down the heap, then reports the largest free block
+void compact()
+{
+    HEAP_INFO info;
+    uint8_t moved = compactStacks();
+
+    if(getHeapInfo(&info))
+        kprintf("%u tasks moved, largest free block %u\n", moved, info.largestFree);
+    else
+        kprintf("%u tasks moved\n", moved);
+}
+
 void kill(uint32_t pid)
 {
-    char str[BUF_SIZE] = {0};
     killThread(pid);
-    putsUart0(itoa(pid, str));
-    putsUart0(" killed\n");
+    kprintf("%u killed\n", pid);
 }
 
 void pkill(char* proc_name)
 {
     killThread(getPid(proc_name));
-    putsUart0(proc_name);
-    putsUart0(" killed\n");
+    kprintf("%s killed\n", proc_name);
+}
+
+void deleteProcess(const char name[])
+{
+    if(removeThread(getPid(name)))
+        kprintf("%s deleted\n", name);
+    else
+        kprintf("%s does not exist...\n", name);
 }
 
 void preempt(bool on)
@@ -431,23 +472,17 @@ void sched(bool prio_on)
 void pidof(const char name[])
 {
     uint32_t pid = getPid(name);
-    char str[BUF_SIZE] = {0};
 
     if(pid > 0)
-        putsUart0(itoa(pid, str));
+        kprintf("%u\n", pid);
     else
-    {
-        putsUart0(name);
-        putsUart0(" does not exist...");
-    }
-    putcUart0('\n');
+        kprintf("%s does not exist...\n", name);
 }
 
 void run(const char name[])
 {
     runThread(getPid(name));
-    putsUart0(name);
-    putsUart0(" launched\n");
+    kprintf("%s launched\n", name);
 }
 
 
@@ -460,108 +495,163 @@ void shell(void)
 
     while(true)
     {
-        if(kbhitUart0())
+        // Get a line from uart and store in data (sleeps until the receive interrupt has a whole one)
+        getsUart0(&data);
+        parseFields(&data);
+
+        // Command evaluation //
+
+        // reboot: Reboots the device
+        if(isCommand(&data, "reboot", 0))
+        {
+            valid = true;
+            clearFields(&data);
+            NVIC_APINT_R = NVIC_APINT_VECTKEY | NVIC_APINT_SYSRESETREQ;
+        }
+
+        // ps: Displays the process (thread) status
+        else if(isCommand(&data, "ps", 0))
+        {
+            ps();
+            valid = true;
+        }
+
+        // ipcs [name]: Displays the inter-process (thread) communication status
+        else if(isCommand(&data, "ipcs", 0))
+        {
+            ipcs(data.fieldCount > 1 ? getFieldString(&data, 1) : NULL);
+            valid = true;
+        }
+
+        // mem [watch seconds]: Displays heap usage, free blocks by size and the owner of each block,
+        //                     or just the usage line once a second
+        else if(isCommand(&data, "mem", 0))
         {
+            if(data.fieldCount > 2 && strcmp(getFieldString(&data, 1), "watch"))
+                memWatch(getFieldInteger(&data, 2));
+            else
+                mem();
+            valid = true;
+        }
+
+        // compact: Moves the stacks of stopped and unrun tasks into lower free blocks so the free space merges
+        else if(isCommand(&data, "compact", 0))
+        {
+            compact();
+            valid = true;
+        }
 
-            // Get string from uart and store in data
-            getsUart0(&data);
-            parseFields(&data);
+        // kill [PID]: Kills the process (thread) with the matching PID
+        else if(isCommand(&data, "kill", 1))
+        {
+            kill(getFieldInteger(&data, 1));
+            valid = true;
+        }
+
+        // Pkill [proc_name]: Kills the process by name
+        else if(isCommand(&data, "pkill", 1))
+        {
+            pkill(getFieldString(&data, 1));
+            valid = true;
+        }
 
-            // Command evaluation //
+        // preempt ON | OFF: Turns preemption on or off
+        else if(isCommand(&data, "preempt", 1))
+        {
+            char* str = getFieldString(&data, 1);
 
-            // reboot: Reboots the device
-            if(isCommand(&data, "reboot", 0))
+            if(strcmp(str, "on"))
             {
+                preempt(true);
                 valid = true;
-                clearFields(&data);
-                NVIC_APINT_R = NVIC_APINT_VECTKEY | NVIC_APINT_SYSRESETREQ;
             }
-
-            // ps: Displays the process (thread) status
-            else if(isCommand(&data, "ps", 0))
+            else if(strcmp(str, "off"))
             {
-                ps();
+                preempt(false);
                 valid = true;
             }
+        }
+
+        // sched PRIO | RR: Selected priority or round-robin scheduling
+        else if(isCommand(&data, "sched", 1))
+        {
+            char* str = getFieldString(&data, 1);
 
-            // ipcs: Displays the inter-process (thread) communication status
-            else if(isCommand(&data, "ipcs", 0))
+            if(strcmp(str, "prio"))
             {
-                ipcs();
+                sched(true);
                 valid = true;
             }
-
-            // kill [PID]: Kills the process (thread) with the matching PID
-            else if(isCommand(&data, "kill", 1))
+            else if(strcmp(str, "rr"))
             {
-                kill(getFieldInteger(&data, 1));
+                sched(false);
                 valid = true;
             }
 
-            // Pkill [proc_name]: Kills the process by name
-            else if(isCommand(&data, "pkill", 1))
+        }
+
+        // pidof proc_name: Displays the PID of the process
+        else if(isCommand(&data, "pidof", 1))
+        {
+            pidof(getFieldString(&data, 1));
+            valid = true;
+        }
+
+        // run proc_name: Runs the selected program in the background
+        else if(isCommand(&data, "run", 1))
+        {
+            run(getFieldString(&data, 1));
+            valid = true;
+        }
+
+        // delete proc_name: Stops the process and frees its stack and task slot
+        else if(isCommand(&data, "delete", 1))
+        {
+            deleteProcess(getFieldString(&data, 1));
+            valid = true;
+        }
+
+        // bench notify | churn | heap | create | print: Measures semaphore vs. task notification round-trip latency,
+        //                                               thread create/delete cost and heap leaks,
+        //                                               the latency distribution of heap allocations and frees,
+        //                                               the cost of creating a thread for each stack size,
+        //                                               or ps formatting with the old itoa chain vs. kprintf
+        else if(isCommand(&data, "bench", 1))
+        {
+            char* str = getFieldString(&data, 1);
+
+            if(strcmp(str, "notify"))
             {
-                pkill(getFieldString(&data, 1));
+                benchNotify();
                 valid = true;
             }
-
-            // preempt ON | OFF: Turns preemption on or off
-            else if(isCommand(&data, "preempt", 1))
+            else if(strcmp(str, "churn"))
             {
-                char* str = getFieldString(&data, 1);
-
-                if(strcmp(str, "on"))
-                {
-                    preempt(true);
-                    valid = true;
-                }
-                else if(strcmp(str, "off"))
-                {
-                    preempt(false);
-                    valid = true;
-                }
+                benchChurn();
+                valid = true;
             }
-
-            // sched PRIO | RR: Selected priority or round-robin scheduling
-            else if(isCommand(&data, "sched", 1))
+            else if(strcmp(str, "heap"))
             {
-                char* str = getFieldString(&data, 1);
-
-                if(strcmp(str, "prio"))
-                {
-                    sched(true);
-                    valid = true;
-                }
-                else if(strcmp(str, "rr"))
-                {
-                    sched(false);
-                    valid = true;
-                }
-
+                benchHeap();
+                valid = true;
             }
-
-            // pidof proc_name: Displays the PID of the process
-            else if(isCommand(&data, "pidof", 1))
+            else if(strcmp(str, "create"))
             {
-                pidof(getFieldString(&data, 1));
+                benchCreate();
                 valid = true;
             }
-
-            // run proc_name: Runs the selected program in the background
-            else if(isCommand(&data, "run", 1))
+            else if(strcmp(str, "print"))
             {
-                run(getFieldString(&data, 1));
+                benchPrint();
                 valid = true;
             }
+        }
 
-            // Look for error
-            if(!valid)
-                putsUart0("Invalid command\n");
+        // Look for error
+        if(!valid)
+            putsUart0("Invalid command\n");
 
-            valid = false;
-            clearFields(&data);
-
-        }
-        yield();
+        valid = false;
+        clearFields(&data);
     }
 }
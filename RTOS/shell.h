@@ -15,6 +15,7 @@
 // Subroutines
 //-----------------------------------------------------------------------------
 
+void ps(void);
 void shell(void);
 
 #endif
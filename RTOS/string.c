@@ -71,6 +71,18 @@ void strcpy(char* destination, const char* str_to_cpy)
     *(destination + i) = '\0';
 }
 
+// Copies at most size - 1 characters and always null terminates
+void strncpy(char* destination, const char* str_to_cpy, uint16_t size)
+{
+    uint16_t i = 0;
+    while(i + 1 < size && *(str_to_cpy + i) != '\0')
+    {
+        *(destination + i) = *(str_to_cpy + i);
+        i++;
+    }
+    *(destination + i) = '\0';
+}
+
 uint64_t pow(uint32_t num, uint8_t exp)
 {
     uint64_t res = 1;
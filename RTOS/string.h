@@ -29,6 +29,7 @@
 char* toLower(char* str);
 bool strcmp(const char str1[], const char str2[]);
 void strcpy(char* destination, const char* str_to_cpy);
+void strncpy(char* destination, const char* str_to_cpy, uint16_t size);
 uint64_t pow(uint32_t num, uint8_t exp);
 char* itoa(uint32_t num, char* buffer);
 char* itohex(uint32_t num, char* buffer);
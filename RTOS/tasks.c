@@ -129,17 +129,27 @@ void idle2(void)
     }
 }
 
-void flash4Hz(void)
+// runs software timer callbacks, so periodic and one-shot work does not need a task and stack each
+void timerDaemon(void)
 {
+    TIMER_EXPIRY expiry;
+
     while(true)
     {
-        setPinValue(GREEN_LED, !getPinValue(GREEN_LED));
-        sleep(125);
+        takeTimer(&expiry);
+        expiry.callback(expiry.arg);
     }
 }
 
+// periodic timer callback (started every 125 ms from main)
+void flash4Hz(uint32_t arg)
+{
+    setPinValue(GREEN_LED, !getPinValue(GREEN_LED));
+}
+
 void oneshot(void)
 {
+    _handle flashReq = getHandle("flashReq");
     while(true)
     {
         wait(flashReq);
@@ -160,6 +170,7 @@ void partOfLengthyFn(void)
 void lengthyFn(void)
 {
     uint16_t i;
+    _handle resource = getHandle("resource");
     while(true)
     {
         lock(resource);
@@ -175,6 +186,10 @@ void lengthyFn(void)
 void readKeys(void)
 {
     uint8_t buttons;
+    _handle keyPressed = getHandle("keyPressed");
+    _handle keyReleased = getHandle("keyReleased");
+    _handle flashReq = getHandle("flashReq");
+    _handle flashTimer = getHandle("flash4Hz");
     while(true)
     {
         wait(keyReleased);
@@ -197,11 +212,11 @@ void readKeys(void)
         }
         if ((buttons & 4) != 0)
         {
-            runThread((uint32_t)flash4Hz);
+            startTimer(flashTimer, 125, true);
         }
         if ((buttons & 8) != 0)
         {
-            killThread((uint32_t)flash4Hz);
+            stopTimer(flashTimer);
         }
         if ((buttons & 16) != 0)
         {
@@ -214,6 +229,8 @@ void readKeys(void)
 void debounce(void)
 {
     uint8_t count;
+    _handle keyPressed = getHandle("keyPressed");
+    _handle keyReleased = getHandle("keyReleased");
     while(true)
     {
         wait(keyPressed);
@@ -256,6 +273,7 @@ void errant(void)
 
 void important(void)
 {
+    _handle resource = getHandle("resource");
     while(true)
     {
         lock(resource);
@@ -19,7 +19,8 @@ void initHw(void);
 
 void idle(void);
 void idle2(void);
-void flash4Hz(void);
+void timerDaemon(void);
+void flash4Hz(uint32_t arg);
 void oneshot(void);
 void partOfLengthyFn(void);
 void lengthyFn(void);
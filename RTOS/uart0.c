@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include "tm4c123gh6pm.h"
 #include "kernel.h"
+#include "asm.h"
 #include "uart0.h"
 
 // PortA masks
@@ -32,6 +33,13 @@
 // Global variables
 //-----------------------------------------------------------------------------
 
+_handle rxPipe = INVALID_HANDLE;                     // pipe fed whole lines by the receive interrupt
+_handle txPipe = INVALID_HANDLE;                     // pipe drained by the transmit interrupt
+
+char line[UART0_LINE_CHARS + 1];                     // line being typed, assembled by the receive interrupt
+uint8_t lineLength = 0;
+bool lineCr = false;                                 // last character ended a line with a carriage return
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -76,24 +84,59 @@ void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc)
                                                         // turn-on UART0
 }
 
-// Blocking function that writes a serial character when the UART buffer is not full
-void putcUart0(char c)
+// Writes a character straight into the fifo, waiting while it is full
+void putcUart0Polled(char c)
 {
     while (UART0_FR_R & UART_FR_TXFF);               // wait if uart0 tx fifo full
     UART0_DR_R = c;                                  // write character to fifo
 }
 
-// Blocking function that writes a string when the UART buffer is not full
-void putsUart0(char* str)
+// Blocking function that writes a serial character, see putnUart0
+void putcUart0(char c)
 {
-    uint8_t i = 0;
-    while (str[i] != '\0')
-        putcUart0(str[i++]);
+    putnUart0(&c, 1);
 }
 
-// Blocking function that returns with serial data once the buffer is not empty
+// Blocking function that writes n characters. Tasks copy them into the transmit pipe and only block while the
+// pipe is full, the transmit interrupt feeds the fifo. Privileged code (startup, faults, the kernel itself)
+// and tasks without a transmit pipe write the fifo directly, privileged code first sending whatever tasks
+// queued so its output never lands inside a log frame (and still gets out from a fault that spins forever)
+void putnUart0(const char* buf, uint32_t n)
+{
+    uint32_t i = 0;
+    char c;
+
+    if(inUnprivilegedTask())
+        i = consoleWrite(buf, n);
+    else
+    {
+        while (txPipe != INVALID_HANDLE && pipeReadFromIsr(txPipe, &c, 1) == 1)
+            putcUart0Polled(c);
+    }
+
+    while (i < n)
+        putcUart0Polled(buf[i++]);
+}
+
+// Blocking function that writes a string, see putnUart0
+void putsUart0(const char* str)
+{
+    uint32_t n = 0;
+
+    while (str[n] != '\0')
+        n++;
+    putnUart0(str, n);
+}
+
+// Blocking function that returns with serial data. Tasks sleep on the receive pipe until a character
+// arrives, without one the fifo is polled (yielding while it is empty)
 char getcUart0()
 {
+    char c;
+
+    if(inUnprivilegedTask() && consoleRead(&c, 1) == 1)
+        return c;
+
     while (UART0_FR_R & UART_FR_RXFE)
     {// wait if uart0 rx fifo empty
         yield();
@@ -101,8 +144,144 @@ char getcUart0()
     return UART0_DR_R & 0xFF;                        // get character from fifo
 }
 
+// Blocking function that reads a line of up to size - 1 characters into buf without its line ending,
+// returns its length. Tasks sleep until the receive interrupt has assembled a whole line, without a
+// receive pipe the line is edited here a character at a time
+uint32_t getlUart0(char buf[], uint32_t size)
+{
+    uint32_t n = 0;
+    char c;
+
+    if(inUnprivilegedTask())
+        n = consoleReadLine(buf, size - 1);          // a line longer than buf is split, the rest is read next
+    if(n > 0)
+    {
+        if(buf[n - 1] == '\n')
+            n--;
+        buf[n] = '\0';
+        return n;
+    }
+
+    while(true)
+    {
+        c = getcUart0();
+        if((c == 8 || c == 127) && n > 0)
+            n--;
+        else if(c == 10 || c == 13)
+            break;
+        else if(c >= 32)
+        {
+            buf[n++] = c;
+            if(n == size - 1)
+                break;
+        }
+    }
+    buf[n] = '\0';
+    return n;
+}
+
 // Returns the status of the receive buffer
 bool kbhitUart0()
 {
     return !(UART0_FR_R & UART_FR_RXFE);
 }
+
+// Lets UART0 interrupt into the kernel (see KERNEL_INT_PRIORITY)
+void enableUart0Interrupt()
+{
+    NVIC_PRI1_R = (NVIC_PRI1_R & ~NVIC_PRI1_INT5_M) | (KERNEL_INT_PRIORITY << 13);
+    NVIC_EN0_R |= 1 << (INT_UART0 - 16);                // turn-on interrupt 21 (UART0)
+}
+
+// Has the receive interrupt edit input into lines (echo, backspace, CR, LF or CRLF endings) and hand each
+// finished line to a pipe, so readers block in getlUart0 until one is complete instead of polling
+// (kbhitUart0 no longer sees any data afterwards)
+void setUart0RxPipe(_handle pipe)
+{
+    rxPipe = pipe;
+    UART0_IM_R |= UART_IM_RXIM | UART_IM_RTIM;          // fifo level and receive timeout interrupts
+    enableUart0Interrupt();
+}
+
+// Sends task output through a pipe emptied by the transmit interrupt
+void setUart0TxPipe(_handle pipe)
+{
+    txPipe = pipe;
+    UART0_IM_R |= UART_IM_TXIM;                         // tx fifo drops below half full
+    enableUart0Interrupt();
+}
+
+_handle getUart0RxPipe()
+{
+    return rxPipe;
+}
+
+_handle getUart0TxPipe()
+{
+    return txPipe;
+}
+
+// The transmit interrupt only fires as the fifo drains, so an idle UART is started by pending it
+// (called from the kernel after writing to the transmit pipe)
+void startUart0Tx()
+{
+    NVIC_PEND0_R = 1 << (INT_UART0 - 16);
+}
+
+// Echoes from the receive interrupt, through the transmit pipe when there is one (the refill in uart0Isr
+// sends it), else into the fifo while it has room
+void echoUart0(const char* str, uint8_t n)
+{
+    uint8_t i;
+
+    if(txPipe != INVALID_HANDLE)
+        pipeWriteFromIsr(txPipe, str, n);
+    else
+        for(i = 0; i < n && !(UART0_FR_R & UART_FR_TXFF); i++)
+            UART0_DR_R = str[i];
+}
+
+// Adds a received character to the line, and passes the line to the receive pipe with a newline when it
+// ends or fills (a line the pipe has no room for is dropped)
+void editLine(char c)
+{
+    bool crlf = lineCr && c == 10;
+
+    lineCr = (c == 13);
+    if(crlf)
+        return;
+
+    if((c == 8 || c == 127) && lineLength > 0)
+    {
+        lineLength--;
+        echoUart0("\b \b", 3);
+    }
+    else if(c >= 32 && lineLength < UART0_LINE_CHARS)
+    {
+        line[lineLength++] = c;
+        echoUart0(&c, 1);
+    }
+
+    if(c == 10 || c == 13 || lineLength == UART0_LINE_CHARS)
+    {
+        echoUart0("\n", 1);
+        line[lineLength++] = '\n';
+        pipeWriteAllFromIsr(rxPipe, line, lineLength);
+        lineLength = 0;
+    }
+}
+
+// Edits everything in the receive fifo into lines for the receive pipe,
+// and refills the transmit fifo from the transmit pipe
+void uart0Isr()
+{
+    uint8_t c;
+
+    while (rxPipe != INVALID_HANDLE && !(UART0_FR_R & UART_FR_RXFE))
+        editLine(UART0_DR_R & 0xFF);
+
+    while (txPipe != INVALID_HANDLE && !(UART0_FR_R & UART_FR_TXFF) && pipeReadFromIsr(txPipe, &c, 1) == 1)
+        UART0_DR_R = c;
+
+    UART0_ICR_R = UART_ICR_RXIC | UART_ICR_RTIC | UART_ICR_TXIC;
+}
@@ -21,15 +21,33 @@
 #ifndef UART0_H_
 #define UART0_H_
 
+#include "kernel.h"
+
+// names of the pipes the console reads from and writes to once setUart0RxPipe and setUart0TxPipe are called
+#define CONSOLE_PIPE    "uart0rx"
+#define CONSOLE_TX_PIPE "uart0tx"
+
+// longest line the receive interrupt assembles, a line reaching it is ended there
+#define UART0_LINE_CHARS 80
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 void initUart0();
 void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc);
+void putcUart0Polled(char c);
 void putcUart0(char c);
-void putsUart0(char* str);
+void putnUart0(const char* buf, uint32_t n);
+void putsUart0(const char* str);
 char getcUart0();
+uint32_t getlUart0(char buf[], uint32_t size);
 bool kbhitUart0();
+void setUart0RxPipe(_handle pipe);
+void setUart0TxPipe(_handle pipe);
+_handle getUart0RxPipe();
+_handle getUart0TxPipe();
+void startUart0Tx();
+void uart0Isr();
 
 #endif
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# Binary log decoder
+# Carson Fabbro
+
+# Reads UART0 output captured from the RTOS (a file, or stdin), passes console text through and
+# replaces each binary log frame (log.h) with its formatted line. Format strings come from the
+# .logstr section of the image that produced the capture:
+#
+#   python3 tools/logdecode.py RTOS/Debug/RTOS.out capture.bin
+
+import re
+import struct
+import sys
+
+LOG_FRAME_MAGIC = 0x1E
+LOG_RECORD_BYTES = 16
+LOG_DROPPED_ID = 1
+CLOCKS_PER_US = 40
+
+FIELD = re.compile(r'%([-0]*)(\d*)(?:\.(\d+))?l?([duxXcs%])')
+
+
+def read_log_strings(path):
+    """Returns (address, bytes) of the .logstr section of a little endian ELF32 image."""
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF' or elf[4] != 1:
+        sys.exit('%s: not an ELF32 image' % path)
+    shoff, = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', elf, 0x2E)
+
+    def section(i):
+        name, _, _, addr, offset, size = struct.unpack_from('<IIIIII', elf, shoff + i * shentsize)
+        return name, addr, offset, size
+
+    _, _, names, _ = section(shstrndx)
+    for i in range(shnum):
+        name, addr, offset, size = section(i)
+        end = elf.index(b'\0', names + name)
+        if elf[names + name:end] == b'.logstr':
+            return addr, elf[offset:offset + size]
+    sys.exit('%s: no .logstr section' % path)
+
+
+def format_field(match, args):
+    flags, width, precision, conversion = match.groups()
+    if conversion == '%':
+        return '%'
+    value = args.pop(0) if args else 0
+    if conversion == 'd' and value & 0x80000000:
+        value -= 1 << 32
+    if conversion in 'du':
+        text = str(abs(value))
+        if precision:
+            digits = int(precision)
+            text = text.rjust(digits + 1, '0')
+            text = text[:-digits] + '.' + text[-digits:]
+        if value < 0:
+            text = '-' + text
+    elif conversion in 'xX':
+        text = ('%X' if conversion == 'X' else '%x') % value
+    elif conversion == 'c':
+        text = chr(value & 0xFF)
+    else:
+        text = '<0x%08X>' % value  # the string itself stayed on the target
+    width = int(width or 0)
+    if '-' in flags:
+        return text.ljust(width)
+    if '0' in flags and conversion != 's':
+        sign = '-' if text.startswith('-') else ''
+        return sign + text[len(sign):].rjust(width - len(sign), '0')
+    return text.rjust(width)
+
+
+def decode_record(record, base, strings):
+    ident, time, a, b = struct.unpack('<IIII', record)
+    if ident == LOG_DROPPED_ID:
+        line = '%u log records dropped' % a
+    elif base <= ident < base + len(strings):
+        start = ident - base
+        fmt = strings[start:strings.index(b'\0', start)].decode('ascii', 'replace')
+        args = [a, b]
+        line = FIELD.sub(lambda m: format_field(m, args), fmt)
+    else:
+        line = 'unknown log id 0x%08X (0x%08X, 0x%08X)' % (ident, a, b)
+    return '[%10u us] %s\n' % (time // CLOCKS_PER_US, line)
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit('usage: logdecode.py IMAGE.out [CAPTURE]')
+    base, strings = read_log_strings(sys.argv[1])
+    capture = open(sys.argv[2], 'rb') if len(sys.argv) == 3 else sys.stdin.buffer
+    out = sys.stdout
+
+    while True:
+        c = capture.read(1)
+        if not c:
+            break
+        if c[0] != LOG_FRAME_MAGIC:
+            out.write(c.decode('latin-1'))
+            continue
+        record = capture.read(LOG_RECORD_BYTES)
+        if len(record) < LOG_RECORD_BYTES:
+            break
+        out.write(decode_record(record, base, strings))
+        out.flush()
+
+
+if __name__ == '__main__':
+    main()